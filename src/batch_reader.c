@@ -0,0 +1,465 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+
+#include "batch_reader.h"
+
+#ifdef WITH_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+enum batch_state {
+    BATCH_UNOPENED, // only the filename is known, open with fopen() when requested
+    BATCH_FAILED,   // open() failed
+    BATCH_QUEUED,   // opened, but read not yet started
+    BATCH_READING,  // read is in flight
+    BATCH_DONE,     // whole file is in buffer
+    BATCH_PASS      // file is read normally through fd
+};
+
+struct batch_slot {
+    char    *filename;
+    void    *data;
+    enum batch_state state;
+    int      errnum;
+    int      fd;
+    uint8_t *buffer;
+    size_t   size;
+    size_t   done;
+#ifdef WITH_IO_URING
+    struct iovec iov;
+#endif
+};
+
+struct batch_reader {
+    struct batch_slot *slots;
+    size_t depth;
+    size_t head;
+    size_t count;
+    size_t buffered;
+    size_t inflight;
+#ifdef WITH_IO_URING
+    int       ring_fd;
+    void     *sq_ptr;
+    size_t    sq_len;
+    void     *cq_ptr;
+    size_t    cq_len;
+    struct io_uring_sqe *sqes;
+    size_t    sqes_len;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned  to_submit;
+#endif
+};
+
+#ifdef WITH_IO_URING
+static int uring_setup(struct batch_reader *reader, unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return errno;
+    }
+
+    reader->ring_fd = fd;
+    reader->sq_len  = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_len  = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+    reader->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    reader->sq_ptr = mmap(NULL, reader->sq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    reader->cq_ptr = mmap(NULL, reader->cq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    reader->sqes   = mmap(NULL, reader->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (reader->sq_ptr == MAP_FAILED || reader->cq_ptr == MAP_FAILED || reader->sqes == MAP_FAILED) {
+        int errnum = errno;
+        if (reader->sq_ptr != MAP_FAILED) munmap(reader->sq_ptr, reader->sq_len);
+        if (reader->cq_ptr != MAP_FAILED) munmap(reader->cq_ptr, reader->cq_len);
+        if (reader->sqes   != MAP_FAILED) munmap(reader->sqes,   reader->sqes_len);
+        close(fd);
+        reader->ring_fd = -1;
+        return errnum;
+    }
+
+    uint8_t *sq = reader->sq_ptr;
+    uint8_t *cq = reader->cq_ptr;
+    reader->sq_tail  = (unsigned *)(sq + params.sq_off.tail);
+    reader->sq_mask  = (unsigned *)(sq + params.sq_off.ring_mask);
+    reader->sq_array = (unsigned *)(sq + params.sq_off.array);
+    reader->cq_head  = (unsigned *)(cq + params.cq_off.head);
+    reader->cq_tail  = (unsigned *)(cq + params.cq_off.tail);
+    reader->cq_mask  = (unsigned *)(cq + params.cq_off.ring_mask);
+    reader->cqes     = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_teardown(struct batch_reader *reader)
+{
+    munmap(reader->sq_ptr, reader->sq_len);
+    munmap(reader->cq_ptr, reader->cq_len);
+    munmap(reader->sqes,   reader->sqes_len);
+    close(reader->ring_fd);
+    reader->ring_fd = -1;
+}
+
+// queue a read of the remaining part of the slot
+static void uring_queue_read(struct batch_reader *reader, size_t index)
+{
+    struct batch_slot *slot = &reader->slots[index];
+    const unsigned tail = *reader->sq_tail;
+    const unsigned sqi  = tail & *reader->sq_mask;
+    struct io_uring_sqe *sqe = &reader->sqes[sqi];
+
+    slot->iov.iov_base = slot->buffer + slot->done;
+    slot->iov.iov_len  = slot->size   - slot->done;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = slot->fd;
+    sqe->off       = slot->done;
+    sqe->addr      = (uintptr_t)&slot->iov;
+    sqe->len       = 1;
+    sqe->user_data = index;
+
+    reader->sq_array[sqi] = sqi;
+    __atomic_store_n(reader->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ++ reader->to_submit;
+    ++ reader->inflight;
+}
+
+// submit queued reads and process completions, wait for at least min_complete of them
+static int uring_enter(struct batch_reader *reader, unsigned int min_complete)
+{
+    for (;;) {
+        int ret = syscall(__NR_io_uring_enter, reader->ring_fd, reader->to_submit,
+            min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+        if (ret >= 0) {
+            reader->to_submit -= (unsigned)ret;
+            break;
+        }
+        else if (errno != EINTR) {
+            return errno;
+        }
+    }
+
+    unsigned head = *reader->cq_head;
+    while (head != __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &reader->cqes[head & *reader->cq_mask];
+        const size_t index = cqe->user_data;
+        const int    res   = cqe->res;
+        struct batch_slot *slot = &reader->slots[index];
+
+        ++ head;
+        -- reader->inflight;
+
+        if (res == -EAGAIN || res == -EINTR) {
+            uring_queue_read(reader, index);
+        }
+        else if (res < 0) {
+            // let stdio run into the error again and report it
+            slot->state = BATCH_PASS;
+        }
+        else if (res == 0) {
+            // file was truncated in the meantime
+            slot->size  = slot->done;
+            slot->state = BATCH_DONE;
+        }
+        else {
+            slot->done += (size_t)res;
+            if (slot->done < slot->size) {
+                uring_queue_read(reader, index);
+            }
+            else {
+                slot->state = BATCH_DONE;
+            }
+        }
+    }
+    __atomic_store_n(reader->cq_head, head, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+// start reads in submission order as long as the buffer budget allows it
+static void uring_start_reads(struct batch_reader *reader)
+{
+    for (size_t i = 0; i < reader->count; ++ i) {
+        const size_t index = (reader->head + i) % reader->depth;
+        struct batch_slot *slot = &reader->slots[index];
+
+        if (slot->state != BATCH_QUEUED) {
+            continue;
+        }
+
+        if (reader->buffered + slot->size > RIPCHECK_BATCH_MAX_BYTES && reader->buffered > 0) {
+            break;
+        }
+
+        slot->buffer = malloc(slot->size);
+        if (!slot->buffer) {
+            slot->state = BATCH_PASS;
+            continue;
+        }
+
+        reader->buffered += slot->size;
+        slot->done  = 0;
+        slot->state = BATCH_READING;
+        uring_queue_read(reader, index);
+    }
+}
+#endif
+
+struct batch_reader *batch_reader_open(size_t depth)
+{
+    struct batch_reader *reader = calloc(1, sizeof(struct batch_reader));
+
+    if (!reader) {
+        return NULL;
+    }
+
+    reader->depth = depth > 0 ? depth : 1;
+    reader->slots = calloc(reader->depth, sizeof(struct batch_slot));
+
+    if (!reader->slots) {
+        free(reader);
+        return NULL;
+    }
+
+#ifdef WITH_IO_URING
+    reader->ring_fd = -1;
+    // without io_uring just fall back to opening files one by one
+    if (depth > 1 && uring_setup(reader, depth) != 0) {
+        reader->ring_fd = -1;
+    }
+#endif
+
+    return reader;
+}
+
+int batch_reader_submit(struct batch_reader *reader, const char *filename, void *data)
+{
+    if (reader->count == reader->depth) {
+        return EAGAIN;
+    }
+
+    const size_t index = (reader->head + reader->count) % reader->depth;
+    struct batch_slot *slot = &reader->slots[index];
+
+    memset(slot, 0, sizeof(*slot));
+    slot->fd = -1;
+    slot->filename = strdup(filename);
+
+    if (!slot->filename) {
+        return errno;
+    }
+
+    slot->data  = data;
+    slot->state = BATCH_UNOPENED;
+    ++ reader->count;
+
+#ifdef WITH_IO_URING
+    if (reader->ring_fd >= 0) {
+        struct stat st;
+
+        slot->fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (slot->fd < 0) {
+            slot->errnum = errno;
+            slot->state  = BATCH_FAILED;
+        }
+        else if (fstat(slot->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+                 (uint64_t)st.st_size > RIPCHECK_BATCH_MAX_FILE_SIZE) {
+            slot->state = BATCH_PASS;
+        }
+        else {
+            slot->size  = st.st_size;
+            slot->state = BATCH_QUEUED;
+            uring_start_reads(reader);
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int batch_reader_next(struct batch_reader *reader, struct batch_file *file)
+{
+    memset(file, 0, sizeof(*file));
+
+    if (reader->count == 0) {
+        return ENOENT;
+    }
+
+    struct batch_slot *slot = &reader->slots[reader->head];
+
+#ifdef WITH_IO_URING
+    if (reader->ring_fd >= 0) {
+        if (slot->state == BATCH_QUEUED) {
+            // can only happen if the budget is used up by files that where not released
+            slot->state = BATCH_PASS;
+        }
+
+        if (reader->to_submit > 0) {
+            uring_enter(reader, 0);
+        }
+
+        while (slot->state == BATCH_READING) {
+            if (uring_enter(reader, 1) != 0) {
+                break;
+            }
+        }
+    }
+#endif
+
+    file->filename = slot->filename;
+    file->data     = slot->data;
+    slot->filename = NULL;
+
+    switch (slot->state) {
+        case BATCH_UNOPENED:
+            file->file = fopen(file->filename, "rb");
+            if (!file->file) {
+                file->errnum = errno;
+            }
+            break;
+
+        case BATCH_FAILED:
+            file->errnum = slot->errnum;
+            break;
+
+#ifdef WITH_IO_URING
+        case BATCH_READING:
+            // io_uring_enter() failed and the kernel might still write into
+            // the buffer, so it is leaked on purpose
+            slot->buffer = NULL;
+            // fall through
+
+        case BATCH_DONE:
+        case BATCH_QUEUED:
+        case BATCH_PASS:
+            if (slot->state == BATCH_DONE) {
+                file->file = fmemopen(slot->buffer, slot->size, "rb");
+                if (file->file) {
+                    file->buffer = slot->buffer;
+                    file->size   = slot->size;
+                    close(slot->fd);
+                    break;
+                }
+                // if fmemopen() fails the buffer is released and the file
+                // is read from disk again
+            }
+
+            if (slot->buffer) {
+                reader->buffered -= slot->size;
+                free(slot->buffer);
+            }
+            lseek(slot->fd, 0, SEEK_SET);
+            file->file = fdopen(slot->fd, "rb");
+            if (!file->file) {
+                file->errnum = errno;
+                close(slot->fd);
+            }
+            break;
+#else
+        default:
+            file->errnum = EINVAL;
+            break;
+#endif
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->fd = -1;
+    reader->head = (reader->head + 1) % reader->depth;
+    -- reader->count;
+
+    return 0;
+}
+
+void batch_reader_release(struct batch_reader *reader, struct batch_file *file)
+{
+    if (file->file) {
+        fclose(file->file);
+    }
+
+    if (file->buffer) {
+        free(file->buffer);
+        reader->buffered -= file->size;
+    }
+
+    free(file->filename);
+    memset(file, 0, sizeof(*file));
+
+#ifdef WITH_IO_URING
+    if (reader->ring_fd >= 0) {
+        uring_start_reads(reader);
+        if (reader->to_submit > 0) {
+            uring_enter(reader, 0);
+        }
+    }
+#endif
+}
+
+void batch_reader_close(struct batch_reader *reader)
+{
+#ifdef WITH_IO_URING
+    if (reader->ring_fd >= 0) {
+        // the kernel might still write into the buffers, so wait for all reads
+        while (reader->inflight > 0) {
+            if (uring_enter(reader, 1) != 0) {
+                break;
+            }
+        }
+        uring_teardown(reader);
+    }
+#endif
+
+    while (reader->count > 0) {
+        struct batch_slot *slot = &reader->slots[reader->head];
+#ifdef WITH_IO_URING
+        if (slot->fd >= 0) {
+            close(slot->fd);
+        }
+#endif
+        free(slot->buffer);
+        free(slot->filename);
+        reader->head = (reader->head + 1) % reader->depth;
+        -- reader->count;
+    }
+
+    free(reader->slots);
+    free(reader);
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,65 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_BATCH_READER_H__
+#define RIPCHECK_BATCH_READER_H__
+
+#include "ripcheck.h"
+
+// files bigger than this are not read into memory but opened normally
+#define RIPCHECK_BATCH_MAX_FILE_SIZE ((size_t)64 * 1024 * 1024)
+
+// maximum number of bytes that are buffered at once
+#define RIPCHECK_BATCH_MAX_BYTES ((size_t)256 * 1024 * 1024)
+
+#define RIPCHECK_DEFAULT_IO_DEPTH (size_t)32
+
+struct batch_reader;
+
+struct batch_file {
+    char  *filename;
+    FILE  *file;
+    int    errnum;
+    // data passed to batch_reader_submit()
+    void  *data;
+
+    // private: in-memory copy of the file
+    void  *buffer;
+    size_t size;
+};
+
+// Reads up to depth files ahead. If depth is 0 or io_uring is not available
+// files are simply opened with fopen() when they are requested.
+struct batch_reader *batch_reader_open(size_t depth);
+
+// Queue a file. Returns EAGAIN if the queue is full. data is returned with
+// the file and is not touched by the reader otherwise.
+int batch_reader_submit(struct batch_reader *reader, const char *filename, void *data);
+
+// Get the next file in the order they where submitted. Returns ENOENT if the
+// queue is empty. If file->file is NULL the file could not be opened and
+// file->errnum contains the reason.
+int batch_reader_next(struct batch_reader *reader, struct batch_file *file);
+
+void batch_reader_release(struct batch_reader *reader, struct batch_file *file);
+
+void batch_reader_close(struct batch_reader *reader);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
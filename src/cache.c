@@ -0,0 +1,480 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "ripcheck cache " RIPCHECK_VERSION
+
+// size of the blocks in which files are read when hashing their content
+#define CACHE_HASH_BLOCK_SIZE (256 * 1024)
+
+#define FNV_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME        UINT64_C(0x100000001b3)
+
+struct ripcheck_cache {
+    char    *dir;
+    int      hash_content;
+    uint8_t *options;
+    size_t   options_size;
+};
+
+struct ripcheck_cache_key {
+    char    *path;
+    uint8_t *data;
+    size_t   size;
+};
+
+struct key_buffer {
+    uint8_t *data;
+    size_t   size;
+    size_t   capacity;
+    int      errnum;
+};
+
+static void key_append(struct key_buffer *buf, const void *data, size_t size)
+{
+    if (buf->errnum != 0) {
+        return;
+    }
+
+    if (buf->size + size > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 128;
+        while (buf->size + size > capacity) capacity *= 2;
+
+        uint8_t *new_data = realloc(buf->data, capacity);
+        if (!new_data) {
+            buf->errnum = errno;
+            return;
+        }
+
+        buf->data     = new_data;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+static void key_append_u64(struct key_buffer *buf, uint64_t value)
+{
+    key_append(buf, &value, sizeof(value));
+}
+
+static void key_append_time(struct key_buffer *buf, const ripcheck_time_t *time)
+{
+    key_append_u64(buf, time->time);
+    key_append_u64(buf, time->unit);
+}
+
+static void key_append_volume(struct key_buffer *buf, const ripcheck_volume_t *volume)
+{
+    key_append_u64(buf, volume->unit);
+
+    if (volume->unit == RIPCHECK_RATIO) {
+        key_append(buf, &volume->volume.ratio, sizeof(volume->volume.ratio));
+    }
+    else {
+        key_append_u64(buf, (int64_t)volume->volume.absolute);
+    }
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++ i) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static int hash_file(const char *filename, uint64_t *hash)
+{
+    FILE *f = fopen(filename, "rb");
+
+    if (!f) {
+        return errno;
+    }
+
+    uint8_t *block = malloc(CACHE_HASH_BLOCK_SIZE);
+    if (!block) {
+        int errnum = errno;
+        fclose(f);
+        return errnum;
+    }
+
+    uint64_t value = FNV_OFFSET_BASIS;
+    size_t count;
+    while ((count = fread(block, 1, CACHE_HASH_BLOCK_SIZE, f)) > 0) {
+        value = fnv1a(value, block, count);
+    }
+
+    int errnum = ferror(f) ? EIO : 0;
+    free(block);
+    fclose(f);
+
+    *hash = value;
+    return errnum;
+}
+
+int ripcheck_make_dirs(char *dir)
+{
+    for (char *ptr = dir + 1;; ++ ptr) {
+        if (*ptr == '/' || *ptr == '\0') {
+            char ch = *ptr;
+            *ptr = '\0';
+            int ok = mkdir(dir, 0755) == 0 || errno == EEXIST;
+            *ptr = ch;
+
+            if (!ok) {
+                return errno;
+            }
+            else if (ch == '\0') {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static char *default_dir(void)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *sub  = "/ripcheck";
+
+    if (!base || !*base) {
+        base = getenv("HOME");
+        sub  = "/.cache/ripcheck";
+
+        if (!base || !*base) {
+            errno = ENOENT;
+            return NULL;
+        }
+    }
+
+    char *dir = malloc(strlen(base) + strlen(sub) + 1);
+    if (dir) {
+        strcpy(dir, base);
+        strcat(dir, sub);
+    }
+
+    return dir;
+}
+
+int ripcheck_cache_open(
+    struct ripcheck_cache **cacheptr,
+    const char *dir,
+    int hash_content,
+    const struct ripcheck_options *options)
+{
+    struct ripcheck_cache *cache = calloc(1, sizeof(struct ripcheck_cache));
+
+    if (!cache) {
+        return errno;
+    }
+
+    cache->dir = dir ? strdup(dir) : default_dir();
+    if (!cache->dir) {
+        int errnum = errno;
+        ripcheck_cache_close(cache);
+        return errnum;
+    }
+
+    int errnum = ripcheck_make_dirs(cache->dir);
+    if (errnum != 0) {
+        ripcheck_cache_close(cache);
+        return errnum;
+    }
+
+    // everything that changes the result of checking a file
+    // (direct_io only changes how it is read)
+    struct key_buffer buf = { NULL, 0, 0, 0 };
+    key_append(&buf, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    key_append_u64(&buf, sizeof(struct ripcheck_context));
+    key_append_time(&buf, &options->max_time);
+    key_append_time(&buf, &options->start_time);
+    key_append_time(&buf, &options->intro_length);
+    key_append_time(&buf, &options->outro_length);
+    key_append_time(&buf, &options->pop_drop_dist);
+    key_append_time(&buf, &options->dupe_dist);
+    key_append_volume(&buf, &options->pop_limit);
+    key_append_volume(&buf, &options->drop_limit);
+    key_append_volume(&buf, &options->dupe_limit);
+    key_append_volume(&buf, &options->clip_limit);
+    key_append_volume(&buf, &options->silence_limit);
+    key_append_time(&buf, &options->min_dropout);
+    key_append_u64(&buf, options->min_dupes);
+    key_append_u64(&buf, options->min_clipped);
+    key_append_u64(&buf, options->max_bad_areas);
+    key_append_u64(&buf, options->window_size);
+    key_append_u64(&buf, options->checksums);
+    key_append_u64(&buf, options->time_budget);
+    key_append_u64(&buf, options->peaks);
+    key_append_u64(&buf, options->detectors);
+    key_append_u64(&buf, options->merge_channels);
+    key_append_time(&buf, &options->merge_dist);
+    key_append_u64(&buf, options->adaptive_limits);
+    key_append_volume(&buf, &options->loudness_floor);
+    key_append_u64(&buf, options->click_ratio);
+    key_append_volume(&buf, &options->click_limit);
+    key_append_u64(&buf, options->stats);
+    key_append_u64(&buf, options->spectrum);
+    key_append_u64(&buf, options->track_count);
+    for (size_t i = 0; i < options->track_count; ++ i) {
+        key_append_u64(&buf, options->tracks[i].number);
+        key_append_u64(&buf, options->tracks[i].start);
+    }
+    key_append_u64(&buf, hash_content);
+
+    if (buf.errnum != 0) {
+        free(buf.data);
+        ripcheck_cache_close(cache);
+        return buf.errnum;
+    }
+
+    cache->hash_content = hash_content;
+    cache->options      = buf.data;
+    cache->options_size = buf.size;
+
+    *cacheptr = cache;
+    return 0;
+}
+
+static int make_key(
+    struct ripcheck_cache *cache,
+    const char *filename,
+    struct ripcheck_cache_key **keyptr)
+{
+    struct stat st;
+
+    if (stat(filename, &st) != 0) {
+        return errno;
+    }
+
+#ifdef __APPLE__
+    const uint64_t mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    const uint64_t mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+
+    struct key_buffer buf = { NULL, 0, 0, 0 };
+    key_append(&buf, cache->options, cache->options_size);
+    key_append_u64(&buf, st.st_dev);
+    key_append_u64(&buf, st.st_ino);
+    key_append_u64(&buf, st.st_size);
+    key_append_u64(&buf, st.st_mtime);
+    key_append_u64(&buf, mtime_nsec);
+
+    if (cache->hash_content) {
+        uint64_t hash = 0;
+        int errnum = hash_file(filename, &hash);
+
+        if (errnum != 0) {
+            free(buf.data);
+            return errnum;
+        }
+
+        key_append_u64(&buf, hash);
+    }
+
+    if (buf.errnum != 0) {
+        free(buf.data);
+        return buf.errnum;
+    }
+
+    struct ripcheck_cache_key *key = calloc(1, sizeof(struct ripcheck_cache_key));
+    const size_t dirlen = strlen(cache->dir);
+
+    if (!key || !(key->path = malloc(dirlen + 1 + 16 + 1))) {
+        int errnum = errno;
+        free(key);
+        free(buf.data);
+        return errnum;
+    }
+
+    snprintf(key->path, dirlen + 1 + 16 + 1, "%s/%016"PRIx64,
+        cache->dir, fnv1a(FNV_OFFSET_BASIS, buf.data, buf.size));
+
+    key->data = buf.data;
+    key->size = buf.size;
+
+    *keyptr = key;
+    return 0;
+}
+
+static int read_entry(
+    const struct ripcheck_cache_key *key,
+    const char *filename,
+    struct ripcheck_record **record,
+    int *status)
+{
+    FILE *f = fopen(key->path, "rb");
+
+    if (!f) {
+        return ENOENT;
+    }
+
+    int errnum = ENOENT;
+    uint64_t size = 0;
+    uint8_t *data = NULL;
+    int64_t value = 0;
+
+    // the whole key is stored to detect hash collisions
+    if (fread(&size, sizeof(size), 1, f) == 1 && size == key->size &&
+        (data = malloc(key->size)) &&
+        fread(data, 1, key->size, f) == key->size &&
+        memcmp(data, key->data, key->size) == 0 &&
+        fread(&value, sizeof(value), 1, f) == 1 &&
+        ripcheck_record_read(record, f, filename) == 0) {
+        *status = (int)value;
+        errnum  = 0;
+    }
+
+    free(data);
+    fclose(f);
+
+    return errnum;
+}
+
+int ripcheck_cache_lookup(
+    struct ripcheck_cache *cache,
+    const char *filename,
+    struct ripcheck_cache_key **keyptr,
+    struct ripcheck_record **record,
+    int *status)
+{
+    struct ripcheck_cache_key *key = NULL;
+    int errnum = make_key(cache, filename, &key);
+
+    *keyptr = NULL;
+
+    if (errnum != 0) {
+        return errnum;
+    }
+
+    errnum = read_entry(key, filename, record, status);
+
+    if (errnum == 0) {
+        ripcheck_cache_key_free(key);
+    }
+    else {
+        *keyptr = key;
+    }
+
+    return errnum;
+}
+
+int ripcheck_cache_store(
+    struct ripcheck_cache *cache,
+    const struct ripcheck_cache_key *key,
+    const struct ripcheck_record *record,
+    int status)
+{
+    (void)cache;
+
+    // I/O errors and the like might not happen the next time
+    if (status != 0 && status != EINVAL) {
+        return 0;
+    }
+    else if (ripcheck_record_error(record) != 0) {
+        return ripcheck_record_error(record);
+    }
+
+    // write to a temporary file and rename it so that concurrent runs
+    // never see half written entries
+    const size_t pathlen = strlen(key->path);
+    char *tmppath = malloc(pathlen + 8);
+
+    if (!tmppath) {
+        return errno;
+    }
+
+    memcpy(tmppath, key->path, pathlen);
+    memcpy(tmppath + pathlen, ".XXXXXX", 8);
+
+    int fd = mkstemp(tmppath);
+    if (fd < 0) {
+        int errnum = errno;
+        free(tmppath);
+        return errnum;
+    }
+
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        int errnum = errno;
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return errnum;
+    }
+
+    uint64_t size  = key->size;
+    int64_t  value = status;
+    int errnum = 0;
+
+    if (fwrite(&size, sizeof(size), 1, f) != 1 ||
+        fwrite(key->data, 1, key->size, f) != key->size ||
+        fwrite(&value, sizeof(value), 1, f) != 1) {
+        errnum = EIO;
+    }
+    else {
+        errnum = ripcheck_record_write(record, f);
+    }
+
+    if (fclose(f) != 0 && errnum == 0) {
+        errnum = errno;
+    }
+
+    if (errnum == 0 && rename(tmppath, key->path) != 0) {
+        errnum = errno;
+    }
+
+    if (errnum != 0) {
+        unlink(tmppath);
+    }
+
+    free(tmppath);
+
+    return errnum;
+}
+
+void ripcheck_cache_key_free(struct ripcheck_cache_key *key)
+{
+    if (!key) return;
+
+    free(key->path);
+    free(key->data);
+    free(key);
+}
+
+void ripcheck_cache_close(struct ripcheck_cache *cache)
+{
+    if (!cache) return;
+
+    free(cache->dir);
+    free(cache->options);
+    free(cache);
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,70 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_CACHE_H__
+#define RIPCHECK_CACHE_H__
+
+#include "ripcheck.h"
+#include "record.h"
+
+struct ripcheck_cache;
+struct ripcheck_cache_key;
+
+// Opens the cache in dir, creating it if necessary. If dir is NULL
+// $XDG_CACHE_HOME/ripcheck or ~/.cache/ripcheck is used. Entries are keyed
+// by device, inode, size and modification time of a file and by the options
+// used to check it. If hash_content is set a hash of the file content is
+// part of the key as well.
+int ripcheck_cache_open(
+    struct ripcheck_cache **cache,
+    const char *dir,
+    int hash_content,
+    const struct ripcheck_options *options);
+
+// Look up the result of checking filename. On a hit 0 is returned, *record
+// has to be freed by the caller and *status is what ripcheck() returned for
+// the file. On a miss ENOENT is returned and *key can be used to store the
+// result once the file is checked. *key is NULL if it could not be computed
+// (e.g. the file does not exist). The key is computed before checking so a
+// file that changes meanwhile does not get cached with the wrong result.
+int ripcheck_cache_lookup(
+    struct ripcheck_cache *cache,
+    const char *filename,
+    struct ripcheck_cache_key **key,
+    struct ripcheck_record **record,
+    int *status);
+
+// Store the result of a file. Only results that don't depend on transient
+// errors are stored.
+int ripcheck_cache_store(
+    struct ripcheck_cache *cache,
+    const struct ripcheck_cache_key *key,
+    const struct ripcheck_record *record,
+    int status);
+
+void ripcheck_cache_key_free(struct ripcheck_cache_key *key);
+
+// Create dir and all its parents. dir is modified while doing so, but
+// restored before returning.
+int ripcheck_make_dirs(char *dir);
+
+void ripcheck_cache_close(struct ripcheck_cache *cache);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
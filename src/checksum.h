@@ -0,0 +1,72 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_CHECKSUM_H__
+#define RIPCHECK_CHECKSUM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct wave_fmt;
+
+struct ripcheck_md5 {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t  buffer[64];
+};
+
+// state of computing all checksums in one pass over the sample data
+struct ripcheck_checksum_state {
+    uint32_t crc32;
+    struct ripcheck_md5 md5;
+
+    // AccurateRip is only defined for 16 bit stereo (CD audio)
+    int      accuraterip;
+    uint32_t accuraterip_v1;
+    uint32_t accuraterip_v2;
+    uint32_t multiplier;
+    uint8_t  pending[4];
+    size_t   pending_length;
+};
+
+struct ripcheck_checksums {
+    int      valid;
+    int      accuraterip;
+    uint32_t crc32;
+    uint32_t accuraterip_v1;
+    uint32_t accuraterip_v2;
+    uint8_t  md5[16];
+};
+
+// Incremental CRC32 (as used by zip and EAC). Start with crc = 0.
+uint32_t ripcheck_crc32(uint32_t crc, const uint8_t *data, size_t size);
+
+void ripcheck_md5_init(struct ripcheck_md5 *md5);
+void ripcheck_md5_update(struct ripcheck_md5 *md5, const uint8_t *data, size_t size);
+void ripcheck_md5_final(struct ripcheck_md5 *md5, uint8_t digest[16]);
+
+void ripcheck_checksum_init(struct ripcheck_checksum_state *state, const struct wave_fmt *fmt);
+
+// Feed raw bytes of the data chunk. The data may be split at any byte.
+void ripcheck_checksum_update(struct ripcheck_checksum_state *state, const uint8_t *data, size_t size);
+
+void ripcheck_checksum_final(struct ripcheck_checksum_state *state, struct ripcheck_checksums *checksums);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
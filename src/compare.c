@@ -0,0 +1,639 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compare.h"
+
+#include <errno.h>
+
+#include "data_reader.h"
+#include "fft.h"
+
+// size of the blocks in which the data chunks are read
+#define COMPARE_BLOCK_SIZE (256 * 1024)
+
+// frames of the first file that are cross-correlated with the second one
+#define COMPARE_EXCERPT 32768
+
+// largest FFT size used to find the offset between the files
+#define COMPARE_WINDOW (4 * COMPARE_EXCERPT)
+
+// the energy of the sliding window is summed up anew this often
+#define COMPARE_ENERGY_REFRESH 4096
+
+// A data chunk of a file that is compared.
+struct compare_file {
+    FILE  *f;
+    off_t  data_start;
+    size_t frames;
+    struct ripcheck_context context;
+};
+
+// A data chunk that is read in blocks, of which frames are left.
+struct compare_stream {
+    struct data_reader *reader;
+    const uint8_t *block;
+    size_t frames;
+};
+
+// the second file is opened without printing its headers
+static void compare_begin(
+    void *data,
+    const struct ripcheck_context *context)
+{
+    (void)data;
+    (void)context;
+}
+
+// Read count frames starting at frame first of the data chunk and mix them
+// down to mono. Frames outside of the data chunk are silent, so first may
+// be negative. raw and samples need to fit COMPARE_EXCERPT frames.
+static int compare_mix(
+    const struct compare_file *file,
+    int64_t first,
+    size_t  count,
+    double *mono,
+    uint8_t *raw,
+    int *samples)
+{
+    const size_t channels    = file->context.fmt.channels;
+    const size_t block_align = file->context.fmt.block_align;
+
+    for (size_t index = 0; index < count;)
+    {
+        const int64_t frame = first + (int64_t)index;
+        size_t length = count - index < COMPARE_EXCERPT ? count - index : COMPARE_EXCERPT;
+        size_t read   = 0;
+
+        if (frame < 0 && (uint64_t)-frame < length)
+        {
+            length = (size_t)-frame;
+        }
+        else if (frame >= 0 && (uint64_t)frame < file->frames)
+        {
+            if (length > file->frames - (size_t)frame)
+            {
+                length = file->frames - (size_t)frame;
+            }
+
+            if (fseeko(file->f, file->data_start + (off_t)frame * block_align, SEEK_SET) != 0)
+            {
+                return errno;
+            }
+
+            // a truncated data chunk is silent at the end
+            read = fread(raw, block_align, length, file->f);
+            if (read < length && ferror(file->f))
+            {
+                return errno;
+            }
+
+            ripcheck_decode(&file->context, raw, read, samples);
+        }
+
+        for (size_t k = 0; k < read; ++ k)
+        {
+            double sum = 0;
+
+            for (size_t channel = 0; channel < channels; ++ channel)
+            {
+                sum += samples[k * channels + channel];
+            }
+
+            mono[index + k] = sum;
+        }
+
+        for (size_t k = read; k < length; ++ k)
+        {
+            mono[index + k] = 0;
+        }
+
+        index += length;
+    }
+
+    return 0;
+}
+
+// Find how many frames later the audio of a is found in b. A part of a is
+// cross-correlated with the part of b that is up to max_offset frames around
+// it via FFT. The cross-correlation is normalized by the energy of b in the
+// window, so loud passages of b don't win. Parts of a at a quarter, half and
+// three quarters of it are tried until one isn't silent. Large offsets are
+// correlated in windows of at most COMPARE_WINDOW frames of b, so memory
+// doesn't grow with max_offset.
+static int compare_align(
+    const struct compare_file *a,
+    const struct compare_file *b,
+    int64_t *offset)
+{
+    const size_t channels = a->context.fmt.channels;
+    const size_t length   = a->frames < COMPARE_EXCERPT ? a->frames : COMPARE_EXCERPT;
+    // a and b don't overlap at all beyond the longer of them
+    const size_t longest  = a->frames > b->frames ? a->frames : b->frames;
+    const size_t max_offset = a->context.max_offset < longest ? a->context.max_offset : longest;
+    const size_t span       = length + 2 * max_offset;
+
+    *offset = 0;
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    size_t size = 2;
+    while (size < span && size < COMPARE_WINDOW)
+    {
+        size *= 2;
+    }
+
+    // lags that one window of b covers
+    const size_t window_lags = size - length + 1;
+
+    struct ripcheck_fft fft;
+    int errnum = ripcheck_fft_init(&fft, size);
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    double  *buffer  = malloc(sizeof(double) * (4 * size + window_lags));
+    uint8_t *raw     = malloc((size_t)a->context.fmt.block_align * COMPARE_EXCERPT);
+    int     *samples = malloc(sizeof(int) * channels * COMPARE_EXCERPT);
+
+    if (!buffer || !raw || !samples)
+    {
+        errnum = errno;
+        free(buffer);
+        free(raw);
+        free(samples);
+        ripcheck_fft_cleanup(&fft);
+        return errnum;
+    }
+
+    double *re_a   = buffer;
+    double *im_a   = re_a + size;
+    double *re_b   = im_a + size;
+    double *im_b   = re_b + size;
+    double *energy = im_b + size;
+    double  best   = 0;
+    size_t  best_dist = 0;
+
+    for (size_t quarter = 1; quarter <= 3 && best == 0 && errnum == 0; ++ quarter)
+    {
+        size_t first = a->frames / 4 * quarter;
+        if (first > a->frames - length) first = a->frames - length;
+
+        errnum = compare_mix(a, (int64_t)first, length, re_a, raw, samples);
+        if (errnum != 0)
+        {
+            break;
+        }
+
+        int silent = 1;
+        for (size_t index = 0; index < length && silent; ++ index)
+        {
+            silent = re_a[index] == 0;
+        }
+
+        if (silent)
+        {
+            continue;
+        }
+
+        for (size_t index = length; index < size; ++ index)
+        {
+            re_a[index] = 0;
+        }
+
+        memset(im_a, 0, sizeof(double) * size);
+
+        ripcheck_fft_forward(&fft, re_a, im_a);
+
+        for (size_t lag0 = 0; lag0 <= 2 * max_offset; lag0 += window_lags)
+        {
+            const size_t left   = 2 * max_offset + 1 - lag0;
+            const size_t lags   = left < window_lags ? left : window_lags;
+            const size_t window = lags + length - 1;
+
+            errnum = compare_mix(b, (int64_t)first - (int64_t)max_offset + (int64_t)lag0, window,
+                re_b, raw, samples);
+            if (errnum != 0)
+            {
+                break;
+            }
+
+            // energy of b in the window of each lag
+            double sum = 0;
+            for (size_t lag = 0; lag < lags; ++ lag)
+            {
+                if (lag % COMPARE_ENERGY_REFRESH == 0)
+                {
+                    sum = 0;
+                    for (size_t index = lag; index < lag + length; ++ index)
+                    {
+                        sum += re_b[index] * re_b[index];
+                    }
+                }
+                else
+                {
+                    const double gone = re_b[lag - 1];
+                    const double come = re_b[lag + length - 1];
+                    sum += come * come - gone * gone;
+                }
+
+                energy[lag] = sum;
+            }
+
+            for (size_t index = window; index < size; ++ index)
+            {
+                re_b[index] = 0;
+            }
+
+            memset(im_b, 0, sizeof(double) * size);
+
+            ripcheck_fft_forward(&fft, re_b, im_b);
+
+            // conj(A) * B is the spectrum of the cross-correlation
+            for (size_t index = 0; index < size; ++ index)
+            {
+                const double re = re_a[index] * re_b[index] + im_a[index] * im_b[index];
+                const double im = re_a[index] * im_b[index] - im_a[index] * re_b[index];
+
+                re_b[index] = re;
+                im_b[index] = im;
+            }
+
+            ripcheck_fft_inverse(&fft, re_b, im_b);
+
+            // lags closer to no offset win a tie, before that the earlier one
+            for (size_t lag = 0; lag < lags; ++ lag)
+            {
+                const double corr = re_b[lag];
+                const size_t at   = lag0 + lag;
+                const size_t dist = at > max_offset ? at - max_offset : max_offset - at;
+
+                if (corr > 0 && energy[lag] > 0)
+                {
+                    const double score = corr * corr / energy[lag];
+
+                    if (score > best || (score == best && dist < best_dist))
+                    {
+                        best      = score;
+                        best_dist = dist;
+                        *offset   = (int64_t)at - (int64_t)max_offset;
+                    }
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    free(raw);
+    free(samples);
+    ripcheck_fft_cleanup(&fft);
+
+    return errnum;
+}
+
+static int compare_stream_open(
+    struct compare_stream *stream,
+    const struct compare_file *file,
+    size_t first,
+    size_t count)
+{
+    const size_t block_align  = file->context.fmt.block_align;
+    const size_t block_frames = COMPARE_BLOCK_SIZE / block_align;
+
+    stream->reader = NULL;
+    stream->block  = NULL;
+    stream->frames = 0;
+
+    if (fseeko(file->f, file->data_start + (off_t)first * block_align, SEEK_SET) != 0)
+    {
+        return errno;
+    }
+
+    return data_reader_open(&stream->reader, file->f, (uint64_t)count * block_align,
+        block_frames * block_align, file->context.direct_io);
+}
+
+// Get the next block if all frames of the current one were compared. frames
+// is 0 at the end of the data.
+static int compare_stream_next(struct compare_stream *stream, size_t block_align)
+{
+    if (stream->frames > 0)
+    {
+        return 0;
+    }
+
+    size_t length = 0;
+    int errnum = data_reader_next(stream->reader, &stream->block, &length);
+
+    // a truncated frame at the end of the data is dropped
+    stream->frames = errnum == 0 ? length / block_align : 0;
+
+    return errnum;
+}
+
+// Report the frames from first to last of a that differ in the channels of mask.
+static int compare_report(
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks,
+    size_t   first,
+    size_t   last,
+    uint64_t mask)
+{
+    context->channel_mask = mask;
+    ++ context->bad_areas;
+
+    callbacks->difference(callbacks->data, context, first, last);
+
+    return context->bad_areas >= context->max_bad_areas;
+}
+
+// Read count frames of both files in lockstep, from frame first_a of a and
+// first_b of b. Differences that are less than a CD sector (1/75 sec) apart
+// are reported as one range, because drives read whole sectors.
+static int compare_data(
+    struct compare_file *a,
+    struct compare_file *b,
+    size_t first_a,
+    size_t first_b,
+    size_t count,
+    struct ripcheck_callbacks *callbacks)
+{
+    struct ripcheck_context *context = &a->context;
+
+    const size_t block_align = context->fmt.block_align;
+    const size_t channels    = context->fmt.channels;
+    const size_t bytes       = (context->fmt.bits_per_sample + 7) / 8;
+    const size_t gap         = context->fmt.sample_rate / 75;
+
+    struct compare_stream stream_a, stream_b;
+    int errnum = compare_stream_open(&stream_a, a, first_a, count);
+
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    errnum = compare_stream_open(&stream_b, b, first_b, count);
+
+    if (errnum != 0)
+    {
+        data_reader_close(stream_a.reader);
+        return errnum;
+    }
+
+    int      open  = 0;
+    int      stop  = 0;
+    size_t   first = 0;
+    size_t   last  = 0;
+    uint64_t mask  = 0;
+    size_t   done  = 0;
+
+    while (done < count && !stop)
+    {
+        if ((errnum = compare_stream_next(&stream_a, block_align)) != 0 ||
+            (errnum = compare_stream_next(&stream_b, block_align)) != 0)
+        {
+            break;
+        }
+
+        size_t frames = stream_a.frames < stream_b.frames ? stream_a.frames : stream_b.frames;
+        if (frames == 0)
+        {
+            break;
+        }
+
+        if (memcmp(stream_a.block, stream_b.block, frames * block_align) != 0)
+        {
+            for (size_t frame = 0; frame < frames && !stop; ++ frame)
+            {
+                const uint8_t *x = stream_a.block + frame * block_align;
+                const uint8_t *y = stream_b.block + frame * block_align;
+                const size_t sample = first_a + done + frame;
+                uint64_t differs = 0;
+                int any = 0;
+
+                if (memcmp(x, y, block_align) == 0)
+                {
+                    continue;
+                }
+
+                // padding bytes at the end of a frame don't count
+                for (size_t channel = 0; channel < channels; ++ channel)
+                {
+                    if (memcmp(x + channel * bytes, y + channel * bytes, bytes) != 0)
+                    {
+                        any = 1;
+                        differs |= channel < 64 ? (uint64_t)1 << channel : 0;
+                    }
+                }
+
+                if (!any)
+                {
+                    continue;
+                }
+
+                if (open && sample > last + gap)
+                {
+                    stop = compare_report(context, callbacks, first, last, mask);
+                    open = 0;
+                }
+
+                if (!open)
+                {
+                    open  = 1;
+                    first = sample;
+                    mask  = 0;
+                }
+
+                last  = sample;
+                mask |= differs;
+            }
+        }
+
+        stream_a.block  += frames * block_align;
+        stream_b.block  += frames * block_align;
+        stream_a.frames -= frames;
+        stream_b.frames -= frames;
+        done += frames;
+    }
+
+    if (open && !stop)
+    {
+        compare_report(context, callbacks, first, last, mask);
+    }
+
+    if (errnum == RIPCHECK_DATA_EOF)
+    {
+        callbacks->warning(callbacks->data, context,
+            "A 'data' chunk ends before its declared size, only %"PRIzu" samples were compared.", done);
+        errnum = 0;
+    }
+    else if (errnum != 0)
+    {
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+    }
+
+    data_reader_close(stream_a.reader);
+    data_reader_close(stream_b.reader);
+
+    return errnum;
+}
+
+// Open a file up to its data chunk. A file without a data chunk is empty.
+static int compare_open(
+    struct compare_file *file,
+    FILE *f,
+    const char *filename,
+    const struct ripcheck_options *options,
+    struct ripcheck_callbacks *callbacks)
+{
+    uint32_t size = 0;
+
+    file->f = f;
+
+    int errnum = ripcheck_open(f, filename, options, &file->context, callbacks);
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    errnum = ripcheck_find_data(f, &file->context, callbacks, &size);
+    if (errnum == ENOENT)
+    {
+        errnum = 0;
+    }
+
+    file->data_start = ftello(f);
+    file->frames     = size / file->context.fmt.block_align;
+
+    if (errnum == 0 && file->data_start < 0)
+    {
+        errnum = errno;
+        callbacks->error(callbacks->data, &file->context, errnum, "%s", strerror(errnum));
+    }
+
+    if (errnum != 0)
+    {
+        ripcheck_context_cleanup(&file->context);
+        return errnum;
+    }
+
+    // like the analysis, the comparison stops at max_time
+    if (file->frames > file->context.max_sample)
+    {
+        file->frames = file->context.max_sample;
+    }
+
+    return 0;
+}
+
+int ripcheck_compare(
+    FILE *a,
+    const char *name_a,
+    FILE *b,
+    const char *name_b,
+    const struct ripcheck_options *options,
+    struct ripcheck_callbacks *callbacks)
+{
+    struct compare_file file_a, file_b;
+    struct ripcheck_callbacks quiet = *callbacks;
+    quiet.begin = compare_begin;
+
+    int errnum = compare_open(&file_a, a, name_a, options, callbacks);
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    struct ripcheck_context *context = &file_a.context;
+    callbacks->sample_data(callbacks->data, context, (uint32_t)(file_a.frames * context->fmt.block_align));
+
+    errnum = compare_open(&file_b, b, name_b, options, &quiet);
+    if (errnum != 0)
+    {
+        ripcheck_context_cleanup(context);
+        return errnum;
+    }
+
+    const struct wave_fmt *fmt_a = &context->fmt;
+    const struct wave_fmt *fmt_b = &file_b.context.fmt;
+
+    if (fmt_a->channels        != fmt_b->channels    ||
+        fmt_a->sample_rate     != fmt_b->sample_rate ||
+        fmt_a->block_align     != fmt_b->block_align ||
+        fmt_a->bits_per_sample != fmt_b->bits_per_sample)
+    {
+        errnum = EINVAL;
+        callbacks->error(callbacks->data, context, errnum,
+            "Can't compare with %s, it has a different format.", name_b);
+    }
+    else
+    {
+        int64_t offset = 0;
+
+        errnum = compare_align(&file_a, &file_b, &offset);
+        if (errnum != 0)
+        {
+            callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        }
+        else
+        {
+            // frame first_a of a is frame first_b of b
+            const size_t first_a = offset < 0 ? (size_t)-offset : 0;
+            const size_t first_b = offset > 0 ? (size_t)offset  : 0;
+            const size_t left_a  = file_a.frames > first_a ? file_a.frames - first_a : 0;
+            const size_t left_b  = file_b.frames > first_b ? file_b.frames - first_b : 0;
+            const size_t count   = left_a < left_b ? left_a : left_b;
+
+            context->compare_filename = name_b;
+            context->compare_offset   = offset;
+
+            errnum = compare_data(&file_a, &file_b, first_a, first_b, count, callbacks);
+
+            if (errnum == 0 && context->bad_areas < context->max_bad_areas)
+            {
+                if (first_a > 0)
+                {
+                    callbacks->warning(callbacks->data, context,
+                        "The first %"PRIzu" samples are missing in %s.", first_a, name_b);
+                }
+
+                if (left_a > count)
+                {
+                    callbacks->warning(callbacks->data, context,
+                        "The last %"PRIzu" samples are missing in %s.", left_a - count, name_b);
+                }
+            }
+        }
+    }
+
+    if (errnum == 0)
+    {
+        callbacks->complete(callbacks->data, context);
+    }
+
+    ripcheck_context_cleanup(&file_b.context);
+    ripcheck_context_cleanup(context);
+
+    return errnum;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
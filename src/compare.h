@@ -0,0 +1,39 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_COMPARE_H__
+#define RIPCHECK_COMPARE_H__
+
+#include "ripcheck.h"
+
+// Compare the audio data of the WAV file b with that of a, e.g. two rips of
+// the same track from different drives. b is aligned to a by cross-correlating
+// a part of both within max_offset, then both are read in lockstep and the
+// ranges that differ are reported through callbacks->difference with the
+// context of a. Both files need the same format and have to be seekable.
+int ripcheck_compare(
+    FILE *a,
+    const char *name_a,
+    FILE *b,
+    const char *name_b,
+    const struct ripcheck_options *options,
+    struct ripcheck_callbacks *callbacks);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
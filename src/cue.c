@@ -0,0 +1,188 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <ctype.h>
+#include <strings.h>
+
+#include "cue.h"
+
+#define CUE_LINE_SIZE 4096
+
+static char *skip_space(char *ptr)
+{
+    while (isspace((unsigned char)*ptr)) ++ ptr;
+    return ptr;
+}
+
+// split off the next word, which may be quoted
+static char *next_word(char **ptrptr)
+{
+    char *ptr = skip_space(*ptrptr);
+    char *word = ptr;
+
+    if (*ptr == '"') {
+        word = ++ ptr;
+        while (*ptr && *ptr != '"') ++ ptr;
+    }
+    else {
+        while (*ptr && !isspace((unsigned char)*ptr)) ++ ptr;
+    }
+
+    if (*ptr) {
+        *ptr ++ = '\0';
+    }
+    *ptrptr = ptr;
+
+    return word;
+}
+
+// mm:ss:ff with 75 frames per second
+static int parse_msf(const char *str, size_t *frames)
+{
+    unsigned int min = 0, sec = 0, frame = 0;
+    char tail = 0;
+
+    if (sscanf(str, "%u:%u:%u%c", &min, &sec, &frame, &tail) != 3 || sec >= 60 || frame >= 75) {
+        return EINVAL;
+    }
+
+    *frames = ((size_t)min * 60 + sec) * 75 + frame;
+    return 0;
+}
+
+int ripcheck_parse_cue(FILE *f, const char *name, struct ripcheck_cue *cue)
+{
+    char   line[CUE_LINE_SIZE];
+    size_t lineno   = 0;
+    size_t capacity = 0;
+    int    has_index01 = 0;
+    int    errnum = 0;
+
+    memset(cue, 0, sizeof(*cue));
+
+    while (errnum == 0 && fgets(line, sizeof(line), f)) {
+        char *ptr = line;
+        ++ lineno;
+
+        // UTF-8 byte order mark
+        if (lineno == 1 && memcmp(ptr, "\xEF\xBB\xBF", 3) == 0) {
+            ptr += 3;
+        }
+
+        char *keyword = next_word(&ptr);
+
+        if (strcasecmp(keyword, "FILE") == 0) {
+            if (cue->filename) {
+                fprintf(stderr, "%s:%"PRIzu": only CUE sheets of a single disc image are supported\n", name, lineno);
+                errnum = EINVAL;
+            }
+            else if (!(cue->filename = strdup(next_word(&ptr)))) {
+                errnum = errno;
+            }
+        }
+        else if (strcasecmp(keyword, "TRACK") == 0) {
+            char *end = NULL;
+            const char *number = next_word(&ptr);
+            unsigned long value = strtoul(number, &end, 10);
+
+            if (end == number || *end || value == 0 || value > 99) {
+                fprintf(stderr, "%s:%"PRIzu": illegal track number: %s\n", name, lineno, number);
+                errnum = EINVAL;
+                break;
+            }
+
+            if (cue->track_count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                struct ripcheck_track *tracks = realloc(cue->tracks, capacity * sizeof(struct ripcheck_track));
+
+                if (!tracks) {
+                    errnum = errno;
+                    break;
+                }
+                cue->tracks = tracks;
+            }
+
+            struct ripcheck_track *track = &cue->tracks[cue->track_count ++];
+            track->number = (unsigned int)value;
+            track->start  = SIZE_MAX;
+            has_index01   = 0;
+        }
+        else if (strcasecmp(keyword, "INDEX") == 0) {
+            const char *index = next_word(&ptr);
+            const char *time  = next_word(&ptr);
+            size_t frames = 0;
+
+            if (cue->track_count == 0) {
+                fprintf(stderr, "%s:%"PRIzu": INDEX outside of a TRACK\n", name, lineno);
+                errnum = EINVAL;
+            }
+            else if (parse_msf(time, &frames) != 0) {
+                fprintf(stderr, "%s:%"PRIzu": illegal index time: %s\n", name, lineno, time);
+                errnum = EINVAL;
+            }
+            else {
+                struct ripcheck_track *track = &cue->tracks[cue->track_count - 1];
+
+                if (strcmp(index, "01") == 0 || strcmp(index, "1") == 0) {
+                    track->start = frames;
+                    has_index01  = 1;
+                }
+                else if (!has_index01 && track->start == SIZE_MAX) {
+                    track->start = frames;
+                }
+            }
+        }
+        // everything else (REM, TITLE, PERFORMER, FLAGS, ...) is irrelevant
+    }
+
+    if (errnum == 0 && ferror(f)) {
+        errnum = EIO;
+    }
+
+    for (size_t i = 0; errnum == 0 && i < cue->track_count; ++ i) {
+        if (cue->tracks[i].start == SIZE_MAX) {
+            fprintf(stderr, "%s: track %u has no INDEX\n", name, cue->tracks[i].number);
+            errnum = EINVAL;
+        }
+        else if (i > 0 && cue->tracks[i].start < cue->tracks[i - 1].start) {
+            fprintf(stderr, "%s: track %u starts before the previous track\n", name, cue->tracks[i].number);
+            errnum = EINVAL;
+        }
+    }
+
+    if (errnum == 0 && (cue->track_count == 0 || !cue->filename)) {
+        fprintf(stderr, "%s: CUE sheet has no FILE or no TRACK\n", name);
+        errnum = EINVAL;
+    }
+
+    if (errnum != 0) {
+        ripcheck_cue_cleanup(cue);
+    }
+
+    return errnum;
+}
+
+void ripcheck_cue_cleanup(struct ripcheck_cue *cue)
+{
+    free(cue->filename);
+    free(cue->tracks);
+    memset(cue, 0, sizeof(*cue));
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,40 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_CUE_H__
+#define RIPCHECK_CUE_H__
+
+#include "ripcheck.h"
+
+struct ripcheck_cue {
+    // audio file of the disc image, relative to the CUE sheet
+    char   *filename;
+    struct ripcheck_track *tracks;
+    size_t  track_count;
+};
+
+// Parse a CUE sheet that describes a single disc image. Tracks start at
+// their INDEX 01 (or the first index if there is no INDEX 01). Syntax
+// errors are reported to stderr prefixed with name.
+int ripcheck_parse_cue(FILE *f, const char *name, struct ripcheck_cue *cue);
+
+void ripcheck_cue_cleanup(struct ripcheck_cue *cue);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
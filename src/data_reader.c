@@ -0,0 +1,446 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// for O_DIRECT
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+
+#if !defined(_WIN16) && !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_DIRECT_IO
+#endif
+
+#include "data_reader.h"
+
+// O_DIRECT needs file offsets, sizes and buffers aligned to the logical block
+// size of the device. 4096 covers all common devices.
+#define DIRECT_IO_ALIGN 4096
+
+enum data_read_mode {
+    DATA_READ_STDIO,    // fread() through the FILE
+    DATA_READ_DIRECT,   // aligned pread() with O_DIRECT
+    DATA_READ_NOCACHE,  // pread() with F_NOCACHE (Mac OS X)
+    DATA_READ_DONTNEED  // pread() and drop the read pages from the cache
+};
+
+struct data_block {
+    uint8_t *buffer;
+    uint8_t *data;
+    size_t   length;
+    int      errnum;
+};
+
+struct data_reader {
+    FILE    *file;
+    uint64_t remaining;
+    size_t   block_size;
+    enum data_read_mode mode;
+    int      fd;
+    int      fd_flags;
+    uint64_t offset;
+    struct data_block blocks[RIPCHECK_READ_AHEAD_BLOCKS];
+    size_t   count;
+    int      done;
+    int      errnum;
+
+#ifdef WITH_THREADS
+    // Single producer single consumer ring. head is only written by the
+    // consumer and tail only by the producer, so passing blocks needs no lock.
+    // The mutex is only used to sleep when the ring is full or empty.
+    int      threaded;
+    size_t   head;
+    size_t   tail;
+    int      stop;
+    int      producer_waiting;
+    int      consumer_waiting;
+    int      fetched;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+#endif
+};
+
+#ifdef HAVE_DIRECT_IO
+static void setup_direct_io(struct data_reader *reader)
+{
+    const int fd = fileno(reader->file);
+    const off_t offset = fd < 0 ? -1 : ftello(reader->file);
+
+    // in memory files and pipes are read normally
+    if (offset < 0) {
+        return;
+    }
+
+    reader->fd     = fd;
+    reader->offset = offset;
+
+#ifdef O_DIRECT
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+        reader->fd_flags = flags;
+        reader->mode     = DATA_READ_DIRECT;
+        return;
+    }
+#endif
+
+#ifdef F_NOCACHE
+    if (fcntl(fd, F_NOCACHE, 1) == 0) {
+        reader->mode = DATA_READ_NOCACHE;
+        return;
+    }
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, offset, reader->remaining, POSIX_FADV_SEQUENTIAL);
+    reader->mode = DATA_READ_DONTNEED;
+#endif
+}
+
+// Reads until size bytes are read or the end of the file. With O_DIRECT a
+// read that ends off the alignment is the end of the file, and reading on
+// from there would fail with EINVAL, so pass that alignment or 1.
+static ssize_t pread_full(int fd, uint8_t *buffer, size_t size, uint64_t offset, size_t align)
+{
+    size_t done = 0;
+
+    while (done < size && done % align == 0) {
+        ssize_t count = pread(fd, buffer + done, size - done, offset + done);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        else if (count == 0) {
+            break;
+        }
+
+        done += count;
+    }
+
+    return done;
+}
+
+static ssize_t read_direct(struct data_reader *reader, struct data_block *block, size_t want)
+{
+    ssize_t count = -1;
+
+#ifdef O_DIRECT
+    if (reader->mode == DATA_READ_DIRECT) {
+        const uint64_t start = reader->offset & ~(uint64_t)(DIRECT_IO_ALIGN - 1);
+        const size_t   skip  = reader->offset - start;
+        const size_t   size  = (skip + want + DIRECT_IO_ALIGN - 1) & ~(size_t)(DIRECT_IO_ALIGN - 1);
+
+        count = pread_full(reader->fd, block->buffer, size, start, DIRECT_IO_ALIGN);
+
+        if (count >= 0) {
+            block->data = block->buffer + skip;
+            count = (size_t)count <= skip ? 0 : (size_t)count - skip;
+            return (size_t)count > want ? (ssize_t)want : count;
+        }
+        else if (errno != EINVAL) {
+            return -1;
+        }
+
+        // the file system refused O_DIRECT after all
+        fcntl(reader->fd, F_SETFL, reader->fd_flags);
+#ifdef POSIX_FADV_DONTNEED
+        reader->mode = DATA_READ_DONTNEED;
+#else
+        reader->mode = DATA_READ_NOCACHE;
+#endif
+    }
+#endif
+
+    block->data = block->buffer;
+    count = pread_full(reader->fd, block->buffer, want, reader->offset, 1);
+
+#ifdef POSIX_FADV_DONTNEED
+    if (count > 0 && reader->mode == DATA_READ_DONTNEED) {
+        posix_fadvise(reader->fd, reader->offset, count, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    return count;
+}
+#endif
+
+// read the next block from the file, sets errnum on the last block
+static void read_block(struct data_reader *reader, struct data_block *block)
+{
+    size_t want = reader->block_size;
+
+    if (want > reader->remaining) {
+        want = reader->remaining;
+    }
+
+    block->errnum = 0;
+
+#ifdef HAVE_DIRECT_IO
+    if (reader->mode != DATA_READ_STDIO) {
+        ssize_t count = want > 0 ? read_direct(reader, block, want) : 0;
+
+        if (count < 0) {
+            block->length = 0;
+            block->errnum = errno;
+        }
+        else {
+            block->length = count;
+            if (block->length < want) {
+                block->errnum = RIPCHECK_DATA_EOF;
+            }
+        }
+
+        reader->offset += block->length;
+    }
+    else
+#endif
+    {
+        block->data   = block->buffer;
+        block->length = want > 0 ? fread(block->buffer, 1, want, reader->file) : 0;
+
+        if (block->length < want) {
+            block->errnum = ferror(reader->file) && errno != 0 ? errno : RIPCHECK_DATA_EOF;
+        }
+    }
+
+    reader->remaining -= block->length;
+}
+
+#ifdef WITH_THREADS
+static void wake(struct data_reader *reader)
+{
+    pthread_mutex_lock(&reader->mutex);
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+static void *read_ahead(void *ptr)
+{
+    struct data_reader *reader = (struct data_reader *)ptr;
+    size_t tail = reader->tail;
+
+    for (;;) {
+        if (tail - __atomic_load_n(&reader->head, __ATOMIC_SEQ_CST) == reader->count) {
+            pthread_mutex_lock(&reader->mutex);
+            __atomic_store_n(&reader->producer_waiting, 1, __ATOMIC_SEQ_CST);
+            while (!__atomic_load_n(&reader->stop, __ATOMIC_SEQ_CST) &&
+                   tail - __atomic_load_n(&reader->head, __ATOMIC_SEQ_CST) == reader->count) {
+                pthread_cond_wait(&reader->cond, &reader->mutex);
+            }
+            __atomic_store_n(&reader->producer_waiting, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&reader->mutex);
+        }
+
+        if (__atomic_load_n(&reader->stop, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+
+        struct data_block *block = &reader->blocks[tail % reader->count];
+        read_block(reader, block);
+
+        ++ tail;
+        __atomic_store_n(&reader->tail, tail, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&reader->consumer_waiting, __ATOMIC_SEQ_CST)) {
+            wake(reader);
+        }
+
+        if (block->length == 0 || block->errnum != 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+int data_reader_open(struct data_reader **readerptr, FILE *f, uint64_t size, size_t block_size, int direct_io)
+{
+    struct data_reader *reader = calloc(1, sizeof(struct data_reader));
+
+    if (!reader) {
+        return errno;
+    }
+
+    reader->file       = f;
+    reader->remaining  = size;
+    reader->block_size = block_size;
+    reader->count      = 1;
+    reader->mode       = DATA_READ_STDIO;
+    reader->fd         = -1;
+
+#ifdef HAVE_DIRECT_IO
+    if (direct_io) {
+        setup_direct_io(reader);
+    }
+#else
+    (void)direct_io;
+#endif
+
+#ifdef WITH_THREADS
+    // a thread doesn't pay off if everything fits into the ring anyway
+    if (size > (uint64_t)block_size * RIPCHECK_READ_AHEAD_BLOCKS) {
+        reader->count = RIPCHECK_READ_AHEAD_BLOCKS;
+    }
+#endif
+
+    for (size_t i = 0; i < reader->count; ++ i) {
+#ifdef HAVE_DIRECT_IO
+        if (reader->mode == DATA_READ_DIRECT) {
+            // room for the unaligned start and end of the block
+            void *buffer = NULL;
+            int errnum = posix_memalign(&buffer, DIRECT_IO_ALIGN, block_size + 2 * DIRECT_IO_ALIGN);
+            if (errnum != 0) {
+                data_reader_close(reader);
+                return errnum;
+            }
+            reader->blocks[i].buffer = buffer;
+            continue;
+        }
+#endif
+        reader->blocks[i].buffer = malloc(block_size);
+
+        if (!reader->blocks[i].buffer) {
+            int errnum = errno;
+            data_reader_close(reader);
+            return errnum;
+        }
+    }
+
+#ifdef WITH_THREADS
+    if (reader->count > 1) {
+        pthread_mutex_init(&reader->mutex, NULL);
+        pthread_cond_init(&reader->cond, NULL);
+
+        int errnum = pthread_create(&reader->thread, NULL, read_ahead, reader);
+        if (errnum != 0) {
+            // just read synchronously
+            pthread_mutex_destroy(&reader->mutex);
+            pthread_cond_destroy(&reader->cond);
+        }
+        else {
+            reader->threaded = 1;
+        }
+    }
+#endif
+
+    *readerptr = reader;
+
+    return 0;
+}
+
+int data_reader_next(struct data_reader *reader, const uint8_t **blockptr, size_t *length)
+{
+    struct data_block *block = NULL;
+
+    *blockptr = NULL;
+    *length   = 0;
+
+    if (reader->done) {
+        // report an error after the data that could still be read
+        int errnum = reader->errnum;
+        reader->errnum = 0;
+        return errnum;
+    }
+
+#ifdef WITH_THREADS
+    if (reader->threaded) {
+        size_t head = reader->head;
+
+        // hand the previous block back to the reader thread
+        if (reader->fetched) {
+            ++ head;
+            __atomic_store_n(&reader->head, head, __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&reader->producer_waiting, __ATOMIC_SEQ_CST)) {
+                wake(reader);
+            }
+        }
+
+        if (head == __atomic_load_n(&reader->tail, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&reader->mutex);
+            __atomic_store_n(&reader->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+            while (head == __atomic_load_n(&reader->tail, __ATOMIC_SEQ_CST)) {
+                pthread_cond_wait(&reader->cond, &reader->mutex);
+            }
+            __atomic_store_n(&reader->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&reader->mutex);
+        }
+
+        reader->fetched = 1;
+        block = &reader->blocks[head % reader->count];
+    }
+    else
+#endif
+    {
+        block = &reader->blocks[0];
+        read_block(reader, block);
+    }
+
+    *blockptr = block->data;
+    *length   = block->length;
+
+    if (block->length == 0 || block->errnum != 0) {
+        reader->done = 1;
+
+        if (block->length == 0) {
+            return block->errnum;
+        }
+
+        reader->errnum = block->errnum;
+    }
+
+    return 0;
+}
+
+void data_reader_close(struct data_reader *reader)
+{
+#ifdef WITH_THREADS
+    if (reader->threaded) {
+        __atomic_store_n(&reader->stop, 1, __ATOMIC_SEQ_CST);
+        wake(reader);
+        pthread_join(reader->thread, NULL);
+        pthread_mutex_destroy(&reader->mutex);
+        pthread_cond_destroy(&reader->cond);
+    }
+#endif
+
+#if defined(HAVE_DIRECT_IO) && defined(O_DIRECT)
+    if (reader->mode == DATA_READ_DIRECT) {
+        fcntl(reader->fd, F_SETFL, reader->fd_flags);
+    }
+#endif
+
+    for (size_t i = 0; i < reader->count; ++ i) {
+        free(reader->blocks[i].buffer);
+    }
+
+    free(reader);
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,47 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_DATA_READER_H__
+#define RIPCHECK_DATA_READER_H__
+
+#include "ripcheck.h"
+
+// number of blocks in the read ahead ring
+#define RIPCHECK_READ_AHEAD_BLOCKS 3
+
+// returned by data_reader_next() if the file ends before all data was read
+#define RIPCHECK_DATA_EOF (-1)
+
+struct data_reader;
+
+// Reads size bytes from f in blocks of block_size bytes. If compiled with
+// thread support the next blocks are read in a separate thread while the
+// current block is analyzed. If direct_io is set the data is read past the
+// page cache (O_DIRECT, F_NOCACHE or POSIX_FADV_DONTNEED, whatever works).
+int data_reader_open(struct data_reader **reader, FILE *f, uint64_t size, size_t block_size, int direct_io);
+
+// Get the next block. The previous block is invalidated by this call.
+// *length is 0 at the end of the data. Returns an errno value or
+// RIPCHECK_DATA_EOF after the last successfully read block if reading failed.
+int data_reader_next(struct data_reader *reader, const uint8_t **block, size_t *length);
+
+void data_reader_close(struct data_reader *reader);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
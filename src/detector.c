@@ -0,0 +1,699 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "detector.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+// Pops and drops both need a zero sample, which is rare in loud audio. They
+// test ZERO_CHUNK frames at a time for one without branches first.
+#define ZERO_CHUNK 16
+
+static int has_zero(const int *x, size_t count)
+{
+    int zero = 0;
+
+    for (size_t index = 0; index < count; ++ index)
+    {
+        zero |= x[index] == 0;
+    }
+
+    return zero;
+}
+
+// ---- pops: four zero samples followed by a loud one ----
+
+static int detect_pops(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    (void)state;
+
+    const size_t channels = context->fmt.channels;
+    const int   *limits   = context->pop_limits;
+
+    // The pop is located 2 frames before the frame it is found at. Pops
+    // need 4 frames before it that were actually read.
+    size_t from = segment->first_read + 5;
+    if (from < segment->pop_after + 2)          from = segment->pop_after + 2;
+    if (from < segment->report_from)            from = segment->report_from;
+    if (from < segment->first_sample)           from = segment->first_sample;
+
+    size_t to = segment->sample_before_outro + 3;
+    if (to > segment->first_sample + segment->frames) to = segment->first_sample + segment->frames;
+
+    for (size_t chunk = from; chunk < to; chunk += ZERO_CHUNK)
+    {
+        const size_t end = to - chunk > ZERO_CHUNK ? chunk + ZERO_CHUNK : to;
+
+        // x3 of every sample of the chunk
+        if (!has_zero(segment->samples + (chunk - segment->first_sample) * channels - 3 * channels,
+                (end - chunk) * channels))
+        {
+            continue;
+        }
+
+        for (size_t sample = chunk; sample < end; ++ sample)
+        {
+            // frames 2 to 6 before the current one
+            const int *x2 = segment->samples + (sample - segment->first_sample) * channels - 2 * channels;
+            const int *x3 = x2 - channels;
+            const int *x4 = x3 - channels;
+            const int *x5 = x4 - channels;
+            const int *x6 = x5 - channels;
+
+            for (size_t channel = 0; channel < channels; ++ channel)
+            {
+                if (x6[channel] == 0 && x5[channel] == 0 && x4[channel] == 0 && x3[channel] == 0 &&
+                    (x2[channel] > limits[channel] || x2[channel] < -limits[channel]))
+                {
+                    int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_POP, channel,
+                        sample, sample - 2, sample - 2);
+                    if (errnum != 0) return errnum;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static unsigned int sweep_zero(const struct ripcheck_context *context)
+{
+    (void)context;
+
+    return RIPCHECK_SWEEP_ZERO;
+}
+
+const struct ripcheck_detector ripcheck_detector_pop = {
+    "pop", 0, sweep_zero, detect_pops, NULL
+};
+
+// ---- drops: a zero sample between two loud ones of the same sign ----
+
+// Drops too close after a pop are removed when the events are reported,
+// because pops are found by another detector.
+static int detect_drops(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    (void)state;
+
+    const size_t channels = context->fmt.channels;
+    const int   *limits   = context->drop_limits;
+
+    // the dropped sample is the one before the frame it is found at
+    size_t from = segment->sample_after_intro + 1;
+    if (from < segment->report_from)  from = segment->report_from;
+    if (from < segment->first_sample) from = segment->first_sample;
+
+    size_t to = segment->sample_before_outro + 2;
+    if (to > segment->first_sample + segment->frames) to = segment->first_sample + segment->frames;
+
+    for (size_t chunk = from; chunk < to; chunk += ZERO_CHUNK)
+    {
+        const size_t end = to - chunk > ZERO_CHUNK ? chunk + ZERO_CHUNK : to;
+
+        // x1 of every sample of the chunk
+        if (!has_zero(segment->samples + (chunk - segment->first_sample) * channels - channels,
+                (end - chunk) * channels))
+        {
+            continue;
+        }
+
+        for (size_t sample = chunk; sample < end; ++ sample)
+        {
+            const int *x0 = segment->samples + (sample - segment->first_sample) * channels;
+            const int *x1 = x0 - channels;
+            const int *x2 = x1 - channels;
+
+            for (size_t channel = 0; channel < channels; ++ channel)
+            {
+                const int limit = limits[channel];
+
+                if (x1[channel] == 0 &&
+                    ((x2[channel] > limit && x0[channel] > limit) ||
+                     (x2[channel] < -limit && x0[channel] < -limit)))
+                {
+                    int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_DROP, channel,
+                        sample, sample - 1, sample - 1);
+                    if (errnum != 0) return errnum;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+const struct ripcheck_detector ripcheck_detector_drop = {
+    "drop", 0, sweep_zero, detect_drops, NULL
+};
+
+// ---- dupes: a run of at least min_dupes equal samples ----
+
+struct dupes_state {
+    // equal neighbours in the current run
+    size_t count;
+    // first sample of the last reported run
+    size_t loc;
+};
+
+static int detect_dupes(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    struct dupes_state *dupes = state;
+
+    const size_t channels  = context->fmt.channels;
+    const int   *limits    = context->dupe_limits;
+    const size_t min_dupes = context->min_dupes;
+    const size_t dist      = context->dupe_dist;
+
+    for (size_t frame = 0; frame < segment->frames; ++ frame)
+    {
+        const int *frame0 = segment->samples + frame * channels;
+        const int *frame1 = frame0 - channels;
+        const size_t sample = segment->first_sample + frame;
+
+        for (size_t channel = 0; channel < channels; ++ channel)
+        {
+            const int x0 = frame0[channel];
+            const int x1 = frame1[channel];
+            struct dupes_state *dupe = &dupes[channel];
+
+            if (x0 == x1) {
+                ++ dupe->count;
+            }
+            else if (dupe->count > 0) {
+                const int limit = limits[channel];
+                size_t dupeloc = sample - dupe->count;
+                if (dupe->count >= min_dupes &&
+                    (x1 <= -limit || x1 >= limit) &&
+                    dupeloc <= segment->sample_before_outro &&
+                    dupeloc >= segment->sample_after_intro &&
+                    sample >= segment->report_from &&
+                    dupeloc > dupe->loc + dist)
+                {
+                    dupe->loc = dupeloc;
+                    int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_DUPES, channel,
+                        sample, dupeloc, dupeloc + dupe->count - 1);
+                    if (errnum != 0) return errnum;
+                }
+                dupe->count = 0;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// There are no three equal samples in a row in skipped frames, so a run is
+// at most one pair long.
+static void resync_dupes(
+    void *state,
+    const struct ripcheck_context *context,
+    const int *samples)
+{
+    struct dupes_state *dupes = state;
+    const size_t channels = context->fmt.channels;
+    const int *last = samples - channels;
+    const int *prev = last - channels;
+
+    for (size_t channel = 0; channel < channels; ++ channel)
+    {
+        dupes[channel].count = last[channel] == prev[channel];
+    }
+}
+
+// a run of two equal samples is found with only one pair of equal neighbours
+static unsigned int sweep_dupes(const struct ripcheck_context *context)
+{
+    return context->min_dupes > 1 ? RIPCHECK_SWEEP_TRIPLE : 0;
+}
+
+const struct ripcheck_detector ripcheck_detector_dupes = {
+    "dupes", sizeof(struct dupes_state), sweep_dupes, detect_dupes, resync_dupes
+};
+
+// ---- clipping: a run of at least min_clipped samples at full scale ----
+
+struct clipping_state {
+    // samples in the current run
+    size_t count;
+    // sign of the samples in the current run
+    int    sign;
+};
+
+// Like dupes, a run is reported at the first sample after it, which is the
+// first sample that isn't clipped or that is clipped at the other side.
+// Clipping is a mastering problem, so the intro and outro are analyzed too.
+static int detect_clipping(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    struct clipping_state *clipping = state;
+
+    const size_t channels    = context->fmt.channels;
+    const int    limit       = context->clip_limit;
+    const size_t min_clipped = context->min_clipped;
+
+    for (size_t frame = 0; frame < segment->frames; ++ frame)
+    {
+        const int *frame0 = segment->samples + frame * channels;
+        const size_t sample = segment->first_sample + frame;
+
+        for (size_t channel = 0; channel < channels; ++ channel)
+        {
+            const int x0 = frame0[channel];
+            const int sign = x0 >= limit ? 1 : x0 <= -limit ? -1 : 0;
+            struct clipping_state *clip = &clipping[channel];
+
+            if (sign != 0 && sign == clip->sign) {
+                ++ clip->count;
+                continue;
+            }
+
+            if (clip->count >= min_clipped && sample >= segment->report_from)
+            {
+                int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_CLIPPING, channel,
+                    sample, sample - clip->count, sample - 1);
+                if (errnum != 0) return errnum;
+            }
+
+            clip->count = sign != 0;
+            clip->sign  = sign;
+        }
+    }
+
+    return 0;
+}
+
+// There are no clipped samples in skipped frames.
+static void resync_clipping(
+    void *state,
+    const struct ripcheck_context *context,
+    const int *samples)
+{
+    struct clipping_state *clipping = state;
+    (void)samples;
+
+    memset(clipping, 0, sizeof(struct clipping_state) * context->fmt.channels);
+}
+
+static unsigned int sweep_clipping(const struct ripcheck_context *context)
+{
+    (void)context;
+
+    return RIPCHECK_SWEEP_CLIP;
+}
+
+const struct ripcheck_detector ripcheck_detector_clipping = {
+    "clipping", sizeof(struct clipping_state), sweep_clipping, detect_clipping, resync_clipping
+};
+
+// ---- dropouts: a run of at least min_dropout silent frames ----
+
+struct dropout_state {
+    // silent frames in the current run
+    size_t count;
+};
+
+// Returns the index of the first sample of x that is louder than the silence
+// limit or count if there is none. A sample is silent if
+// (unsigned)x + offset <= span, so exact digital zero is offset = span = 0.
+// Silent stretches are skipped 16 samples at a time with a branch free test.
+static size_t dropout_scan(const int *x, size_t count, unsigned int offset, unsigned int span)
+{
+    size_t index = 0;
+
+    // in loud audio the first sample decides
+    if (count == 0 || (unsigned int)x[0] + offset > span)
+    {
+        return 0;
+    }
+
+    for (; index + 16 <= count; index += 16)
+    {
+        unsigned int loud = 0;
+
+        for (size_t k = 0; k < 16; ++ k)
+        {
+            loud |= (unsigned int)x[index + k] + offset > span;
+        }
+
+        if (loud) break;
+    }
+
+    while (index < count && (unsigned int)x[index] + offset <= span)
+    {
+        ++ index;
+    }
+
+    return index;
+}
+
+// A dropout is a stretch where all channels are silent at once, so only the
+// state of the first channel is used and a dropout is reported once, for
+// channel 0, at the first frame after it. Like dupes, dropouts in the intro
+// and outro are ignored.
+static int detect_dropouts(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    struct dropout_state *dropout = state;
+
+    const size_t       channels    = context->fmt.channels;
+    const unsigned int offset      = context->silence_limit;
+    const unsigned int span        = 2u * context->silence_limit;
+    const size_t       min_dropout = context->min_dropout;
+
+    for (size_t frame = 0; frame < segment->frames; ++ frame)
+    {
+        const size_t silent = dropout_scan(segment->samples + frame * channels,
+            (segment->frames - frame) * channels, offset, span) / channels;
+
+        dropout->count += silent;
+        frame          += silent;
+
+        if (frame == segment->frames)
+        {
+            break;
+        }
+
+        const size_t sample     = segment->first_sample + frame;
+        const size_t dropoutloc = sample - dropout->count;
+
+        if (dropout->count >= min_dropout &&
+            dropoutloc <= segment->sample_before_outro &&
+            dropoutloc >= segment->sample_after_intro &&
+            sample >= segment->report_from)
+        {
+            int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_DROPOUT, 0,
+                sample, dropoutloc, sample - 1);
+            if (errnum != 0) return errnum;
+        }
+
+        dropout->count = 0;
+    }
+
+    return 0;
+}
+
+// There are no zero samples in skipped frames.
+static void resync_dropouts(
+    void *state,
+    const struct ripcheck_context *context,
+    const int *samples)
+{
+    struct dropout_state *dropout = state;
+    (void)context;
+    (void)samples;
+
+    dropout->count = 0;
+}
+
+// only exact digital zero can be swept for
+static unsigned int sweep_dropouts(const struct ripcheck_context *context)
+{
+    return context->silence_limit == 0 ? RIPCHECK_SWEEP_ZERO : 0;
+}
+
+const struct ripcheck_detector ripcheck_detector_dropout = {
+    "dropout", sizeof(struct dropout_state), sweep_dropouts, detect_dropouts, resync_dropouts
+};
+
+// ---- clicks: a sample that sticks out of its neighbourhood ----
+
+// The running level is an exponential integrator over 2^CLICK_LEVEL_SHIFT
+// samples and is kept scaled by that factor.
+#define CLICK_LEVEL_SHIFT 8
+// The prefilter looks at this many frames at a time.
+#define CLICK_CHUNK 16
+
+struct click_state {
+    // running mean of the absolute second difference << CLICK_LEVEL_SHIFT
+    int64_t level;
+};
+
+static inline int64_t abs64(int64_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+// absolute second difference around the sample stride before x
+static inline int64_t click_diff(const int *x, ptrdiff_t stride)
+{
+    return abs64((int64_t)x[-2 * stride] - 2 * (int64_t)x[-stride] + x[0]);
+}
+
+// A click at k makes the second difference x[k-1] - 2 x[k] + x[k+1] stick out
+// of the running level by more than click_ratio. The prefilter only finds the
+// biggest second difference of a chunk of frames and updates the level once
+// per chunk, which has no branches. The samples of a chunk that passes are
+// confirmed if the second difference peaks at k and x[k] also sticks out of
+// the cubic interpolation of the two samples on either side, which follows
+// smooth signals much closer. Only a lone spike is a click: x[k] has to jump
+// away from both neighbours in the same direction and by comparable steps, and
+// neither neighbour may start a run of equal samples, so that the edges of
+// clipping, dropouts and steps are left to the other detectors. A click is
+// found 2 frames after it. Like dupes, clicks in the intro and outro are
+// ignored.
+static int detect_clicks(
+    void *state,
+    const struct ripcheck_context *context,
+    const struct ripcheck_segment *segment,
+    struct ripcheck_events *events)
+{
+    struct click_state *clicks = state;
+
+    const size_t    channels = context->fmt.channels;
+    const ptrdiff_t stride   = channels;
+    const int64_t   ratio    = context->click_ratio;
+    // the second difference is twice the deviation from the linear interpolation
+    const int64_t   floor    = 2 * (int64_t)context->click_limit;
+
+    // the level needs RIPCHECK_CLICK_WARMUP samples to settle
+    size_t from = segment->first_read + RIPCHECK_CLICK_WARMUP;
+    if (from < segment->sample_after_intro + 2) from = segment->sample_after_intro + 2;
+    if (from < segment->report_from)            from = segment->report_from;
+
+    // a channel at a time keeps its level in a register
+    for (size_t channel = 0; channel < channels; ++ channel)
+    {
+        int64_t level = clicks[channel].level;
+
+        for (size_t frame = 0; frame < segment->frames; frame += CLICK_CHUNK)
+        {
+            const size_t count = segment->frames - frame < CLICK_CHUNK ?
+                segment->frames - frame : CLICK_CHUNK;
+            const int *chunk = segment->samples + frame * channels + channel - stride;
+            int64_t sum  = 0;
+            int64_t peak = 0;
+
+            for (size_t index = 0; index < count; ++ index)
+            {
+                const int64_t diff = click_diff(chunk + index * stride, stride);
+                sum += diff;
+                peak = diff > peak ? diff : peak;
+            }
+
+            const int64_t limit = level * ratio;
+            level += sum - (level >> CLICK_LEVEL_SHIFT) * (int64_t)count;
+
+            if ((peak << CLICK_LEVEL_SHIFT) <= limit || peak <= floor)
+            {
+                continue;
+            }
+
+            for (size_t index = 0; index < count; ++ index)
+            {
+                const int *x = chunk + index * stride;
+                const int64_t diff = click_diff(x, stride);
+                const size_t sample = segment->first_sample + frame + index;
+
+                if ((diff << CLICK_LEVEL_SHIFT) <= limit || diff <= floor ||
+                    sample < from || sample > segment->sample_before_outro + 2)
+                {
+                    continue;
+                }
+
+                const int64_t xm2 = x[-3 * stride];
+                const int64_t xm1 = x[-2 * stride];
+                const int64_t xk  = x[-stride];
+                const int64_t xp1 = x[0];
+                const int64_t xp2 = x[stride];
+
+                const int64_t before = abs64(xm2 - 2 * xm1 + xk);
+                const int64_t after  = abs64(xk - 2 * xp1 + xp2);
+                // 6 times the deviation from (-x[k-2] + 4 x[k-1] + 4 x[k+1] - x[k+2]) / 6,
+                // which is 3 times the second difference for a lone spike
+                const int64_t cubic  = abs64(6 * xk + xm2 - 4 * xm1 - 4 * xp1 + xp2);
+                // x[k] leaves and comes back, neither step is much smaller
+                const int64_t rise = xk - xm1;
+                const int64_t fall = xk - xp1;
+
+                if (diff > before && diff >= after &&
+                    cubic > 3 * floor &&
+                    (cubic << CLICK_LEVEL_SHIFT) > 3 * limit &&
+                    (rise > 0) == (fall > 0) && rise != 0 && fall != 0 &&
+                    3 * abs64(rise) >= abs64(fall) && 3 * abs64(fall) >= abs64(rise) &&
+                    xm1 != xm2 && xp1 != xp2)
+                {
+                    int errnum = ripcheck_events_add(events, RIPCHECK_EVENT_CLICK, channel,
+                        sample, sample - 2, sample - 2);
+                    if (errnum != 0) return errnum;
+                }
+            }
+        }
+
+        clicks[channel].level = level;
+    }
+
+    return 0;
+}
+
+const struct ripcheck_detector ripcheck_detector_click = {
+    "click", sizeof(struct click_state), NULL, detect_clicks, NULL
+};
+
+// ---- registry ----
+
+// The order is the order in which events found at the same sample are
+// reported. Indices are bits in the detectors bitmask.
+const struct ripcheck_detector *ripcheck_detectors[] = {
+    &ripcheck_detector_pop,
+    &ripcheck_detector_drop,
+    &ripcheck_detector_dupes,
+    &ripcheck_detector_clipping,
+    &ripcheck_detector_dropout,
+    &ripcheck_detector_click,
+    NULL
+};
+
+size_t ripcheck_detector_count(void)
+{
+    return sizeof(ripcheck_detectors) / sizeof(ripcheck_detectors[0]) - 1;
+}
+
+int ripcheck_parse_detectors(const char *str, unsigned int *detectors)
+{
+    unsigned int mask = 0;
+
+    while (*str) {
+        const char *comma = strchr(str, ',');
+        const size_t len  = comma ? (size_t)(comma - str) : strlen(str);
+        size_t index = 0;
+
+        for (; ripcheck_detectors[index]; ++ index) {
+            if (strlen(ripcheck_detectors[index]->name) == len &&
+                strncasecmp(ripcheck_detectors[index]->name, str, len) == 0) {
+                break;
+            }
+        }
+
+        if (!ripcheck_detectors[index]) {
+            return EINVAL;
+        }
+
+        mask |= 1u << index;
+        str  += comma ? len + 1 : len;
+    }
+
+    if (mask == 0) {
+        return EINVAL;
+    }
+
+    *detectors = mask;
+
+    return 0;
+}
+
+int ripcheck_events_add(
+    struct ripcheck_events *events,
+    enum ripcheck_event_type type,
+    uint16_t channel,
+    size_t sample,
+    size_t first_sample,
+    size_t last_sample)
+{
+    if (events->count == events->capacity) {
+        size_t capacity = events->capacity ? events->capacity * 2 : 64;
+        struct ripcheck_event *buf = realloc(events->events, capacity * sizeof(struct ripcheck_event));
+
+        if (!buf) {
+            return errno;
+        }
+
+        events->events   = buf;
+        events->capacity = capacity;
+    }
+
+    struct ripcheck_event *event = &events->events[events->count];
+    event->sample       = sample;
+    event->first_sample = first_sample;
+    event->last_sample  = last_sample;
+    event->channel      = channel;
+    event->type         = type;
+    event->order        = events->count;
+    ++ events->count;
+
+    return 0;
+}
+
+static int compare_events(const void *lhs, const void *rhs)
+{
+    const struct ripcheck_event *a = lhs;
+    const struct ripcheck_event *b = rhs;
+
+    if (a->sample  != b->sample)  return a->sample  < b->sample  ? -1 : 1;
+    if (a->channel != b->channel) return a->channel < b->channel ? -1 : 1;
+    if (a->order   != b->order)   return a->order   < b->order   ? -1 : 1;
+
+    return 0;
+}
+
+void ripcheck_events_sort(struct ripcheck_events *events)
+{
+    if (events->count > 1) {
+        qsort(events->events, events->count, sizeof(struct ripcheck_event), compare_events);
+    }
+}
+
+void ripcheck_events_cleanup(struct ripcheck_events *events)
+{
+    free(events->events);
+    events->events   = NULL;
+    events->count    = 0;
+    events->capacity = 0;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,139 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RIPCHECK_DETECTOR_H__
+#define RIPCHECK_DETECTOR_H__
+
+#include "ripcheck.h"
+
+enum ripcheck_event_type {
+    RIPCHECK_EVENT_POP,
+    RIPCHECK_EVENT_DROP,
+    RIPCHECK_EVENT_DUPES,
+    RIPCHECK_EVENT_CLIPPING,
+    RIPCHECK_EVENT_DROPOUT,
+    RIPCHECK_EVENT_CLICK,
+    // folded into an event of another channel when it was reported
+    RIPCHECK_EVENT_MERGED
+};
+
+// A problem found by a detector. sample is the frame at which it was found,
+// which is the last frame of the window passed to the callbacks.
+struct ripcheck_event {
+    size_t   sample;
+    size_t   first_sample;
+    size_t   last_sample;
+    uint16_t channel;
+    uint16_t type;
+    // events found at the same sample in the same channel keep the order in
+    // which they were added, which is the order of the detectors
+    size_t   order;
+};
+
+struct ripcheck_events {
+    struct ripcheck_event *events;
+    size_t count;
+    size_t capacity;
+};
+
+// Decoded frames that a detector analyzes in one go. The intro, outro and
+// reporting bounds don't change within a segment. The window_size - 1 frames
+// before samples are valid too and hold zeros before the first frame read.
+struct ripcheck_segment {
+    // interleaved samples of all channels
+    const int *samples;
+    // number of the frame samples points to and the frames in the segment
+    size_t first_sample;
+    size_t frames;
+    // first frame that was read, the frames before it are zeros
+    size_t first_read;
+    // don't report problems found before this frame
+    size_t report_from;
+    size_t sample_after_intro;
+    size_t sample_before_outro;
+    // pops are only excluded from the intro at track boundaries
+    size_t pop_after;
+};
+
+// What the coarse sweep over packed 16 and 24 bit frames looks for. A detector that
+// returns these from sweep can only find something within 6 frames after
+// such a sample, so blocks without any of them are skipped.
+#define RIPCHECK_SWEEP_ZERO   0x1 // a zero sample
+#define RIPCHECK_SWEEP_TRIPLE 0x2 // three equal samples in a row
+#define RIPCHECK_SWEEP_CLIP   0x4 // a sample at or beyond clip_limit
+
+struct ripcheck_detector {
+    const char *name;
+    // bytes of state per channel, zeroed before the analysis starts
+    size_t state_size;
+
+    // RIPCHECK_SWEEP_* flags for the given settings. If this is NULL or
+    // returns 0 no frames are skipped while the detector is enabled.
+    unsigned int (*sweep)(const struct ripcheck_context *context);
+
+    // Analyze all frames of a segment in order and add what is found to
+    // events, in order for each channel. Events are sorted by frame before
+    // they are reported. Returns an errno value.
+    int  (*detect)(
+        void *state,
+        const struct ripcheck_context *context,
+        const struct ripcheck_segment *segment,
+        struct ripcheck_events *events);
+
+    // Frames before the frame samples points to were skipped because the
+    // sweep found nothing in them. Only the window_size - 1 frames before it
+    // are valid. May be NULL.
+    void (*resync)(
+        void *state,
+        const struct ripcheck_context *context,
+        const int *samples);
+};
+
+extern const struct ripcheck_detector *ripcheck_detectors[];
+
+// bitmask of the detectors that run if none are given (clipping, dropout and
+// click are opt-in)
+#define RIPCHECK_DETECTORS_DEFAULT 0x7u
+
+// frames the click detector needs to learn the level of a channel
+#define RIPCHECK_CLICK_WARMUP 1024
+
+// number of detectors in ripcheck_detectors
+size_t ripcheck_detector_count(void);
+
+// Parse a comma separated list of detector names into a bitmask of indices
+// into ripcheck_detectors.
+int ripcheck_parse_detectors(const char *str, unsigned int *detectors);
+
+int ripcheck_events_add(
+    struct ripcheck_events *events,
+    enum ripcheck_event_type type,
+    uint16_t channel,
+    size_t sample,
+    size_t first_sample,
+    size_t last_sample);
+
+// sort events by sample, channel and detector
+void ripcheck_events_sort(struct ripcheck_events *events);
+
+void ripcheck_events_cleanup(struct ripcheck_events *events);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,363 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+
+#include "duplicates.h"
+#include "ripcheck_endian.h"
+
+// size and number of the blocks that are hashed for the fingerprint
+#define FINGERPRINT_BLOCK_SIZE  (64 * 1024)
+#define FINGERPRINT_BLOCK_COUNT 3
+
+// maximum number of files with the same fingerprint that are compared
+#define MAX_CANDIDATES 8
+
+// size of the blocks in which the data chunk is read to confirm a match
+#define CONFIRM_BLOCK_SIZE (256 * 1024)
+
+struct duplicate_entry {
+    struct duplicate_entry *next;
+    struct ripcheck_fingerprint fingerprint;
+    uint8_t md5[16];
+    char   *filename;
+    struct ripcheck_record *record;
+    int     status;
+};
+
+struct ripcheck_duplicates {
+    struct duplicate_entry **buckets;
+    size_t bucket_count;
+    size_t count;
+#ifdef WITH_THREADS
+    pthread_mutex_t mutex;
+#endif
+};
+
+int ripcheck_duplicates_create(struct ripcheck_duplicates **dupsptr)
+{
+    struct ripcheck_duplicates *dups = calloc(1, sizeof(struct ripcheck_duplicates));
+
+    if (!dups) {
+        return errno;
+    }
+
+    dups->bucket_count = 256;
+    dups->buckets = calloc(dups->bucket_count, sizeof(struct duplicate_entry*));
+
+    if (!dups->buckets) {
+        int errnum = errno;
+        free(dups);
+        return errnum;
+    }
+
+#ifdef WITH_THREADS
+    pthread_mutex_init(&dups->mutex, NULL);
+#endif
+
+    *dupsptr = dups;
+    return 0;
+}
+
+static size_t fingerprint_hash(const struct ripcheck_fingerprint *fingerprint)
+{
+    return (size_t)fingerprint->crc32 ^ ((size_t)fingerprint->data_size * 31);
+}
+
+static int fingerprint_equals(const struct ripcheck_fingerprint *a, const struct ripcheck_fingerprint *b)
+{
+    return a->crc32 == b->crc32 && a->data_size == b->data_size &&
+        memcmp(&a->fmt, &b->fmt, sizeof(a->fmt)) == 0;
+}
+
+// find the fmt and data chunks without reporting anything
+static int find_data(FILE *f, struct ripcheck_fingerprint *fingerprint)
+{
+    uint8_t header[12];
+    int have_fmt = 0;
+
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return EINVAL;
+    }
+
+    for (;;) {
+        struct riff_chunk_header chunk;
+
+        if (fread(&chunk, sizeof(chunk), 1, f) != 1) {
+            return EINVAL;
+        }
+
+        const uint32_t chunk_size = le32toh(chunk.size);
+
+        if (memcmp(chunk.id, "fmt ", 4) == 0 && chunk_size >= sizeof(struct wave_fmt)) {
+            if (fread(&fingerprint->fmt, sizeof(struct wave_fmt), 1, f) != 1 ||
+                fseek(f, chunk_size - sizeof(struct wave_fmt), SEEK_CUR) != 0) {
+                return EINVAL;
+            }
+            have_fmt = 1;
+        }
+        else if (memcmp(chunk.id, "data", 4) == 0) {
+            if (!have_fmt) {
+                return EINVAL;
+            }
+
+            fingerprint->data_size   = chunk_size;
+            fingerprint->data_offset = ftell(f);
+            return fingerprint->data_offset < 0 ? errno : 0;
+        }
+        else if (fseek(f, chunk_size, SEEK_CUR) != 0) {
+            return EINVAL;
+        }
+    }
+}
+
+static int make_fingerprint(FILE *f, struct ripcheck_fingerprint *fingerprint)
+{
+    memset(fingerprint, 0, sizeof(*fingerprint));
+
+    int errnum = find_data(f, fingerprint);
+    if (errnum != 0) {
+        return errnum;
+    }
+
+    uint8_t *block = malloc(FINGERPRINT_BLOCK_SIZE);
+    if (!block) {
+        return errno;
+    }
+
+    // blocks at the start, in the middle and at the end of the data
+    const uint32_t size = fingerprint->data_size;
+    const uint32_t step = size > FINGERPRINT_BLOCK_SIZE ?
+        (size - FINGERPRINT_BLOCK_SIZE) / (FINGERPRINT_BLOCK_COUNT - 1) : 0;
+    uint32_t crc = 0;
+
+    for (size_t i = 0; i < FINGERPRINT_BLOCK_COUNT && errnum == 0; ++ i) {
+        const size_t length = size < FINGERPRINT_BLOCK_SIZE ? size : FINGERPRINT_BLOCK_SIZE;
+
+        if (fseek(f, fingerprint->data_offset + (long)(step * i), SEEK_SET) != 0) {
+            errnum = errno;
+        }
+        else {
+            // a truncated file is hashed as far as it goes
+            const size_t count = fread(block, 1, length, f);
+            crc = ripcheck_crc32(crc, block, count);
+        }
+    }
+
+    free(block);
+
+    fingerprint->crc32 = crc;
+    fingerprint->valid = errnum == 0;
+
+    return errnum;
+}
+
+static int data_md5(FILE *f, const struct ripcheck_fingerprint *fingerprint, uint8_t md5[16])
+{
+    if (fseek(f, fingerprint->data_offset, SEEK_SET) != 0) {
+        return errno;
+    }
+
+    uint8_t *block = malloc(CONFIRM_BLOCK_SIZE);
+    if (!block) {
+        return errno;
+    }
+
+    struct ripcheck_md5 state;
+    size_t left = fingerprint->data_size;
+    ripcheck_md5_init(&state);
+
+    while (left > 0) {
+        const size_t count = fread(block, 1, left < CONFIRM_BLOCK_SIZE ? left : CONFIRM_BLOCK_SIZE, f);
+
+        if (count == 0) {
+            break;
+        }
+        ripcheck_md5_update(&state, block, count);
+        left -= count;
+    }
+
+    int errnum = ferror(f) ? EIO : 0;
+    free(block);
+    ripcheck_md5_final(&state, md5);
+
+    return errnum;
+}
+
+int ripcheck_duplicates_lookup(
+    struct ripcheck_duplicates *dups,
+    FILE *f,
+    struct ripcheck_fingerprint *fingerprint,
+    const struct ripcheck_record **record,
+    const char **original,
+    int *status)
+{
+    int errnum = make_fingerprint(f, fingerprint);
+    int found  = 0;
+    uint8_t md5[16];
+
+    if (errnum == 0) {
+        // entries are never freed before dups, so they can be compared
+        // without holding the lock while reading the file
+        struct duplicate_entry *candidates[MAX_CANDIDATES];
+        size_t count = 0;
+
+#ifdef WITH_THREADS
+        pthread_mutex_lock(&dups->mutex);
+#endif
+        struct duplicate_entry *entry = dups->buckets[fingerprint_hash(fingerprint) % dups->bucket_count];
+        for (; entry && count < MAX_CANDIDATES; entry = entry->next) {
+            if (fingerprint_equals(&entry->fingerprint, fingerprint)) {
+                candidates[count ++] = entry;
+            }
+        }
+#ifdef WITH_THREADS
+        pthread_mutex_unlock(&dups->mutex);
+#endif
+
+        // the MD5 of the new file is only needed once there is a candidate
+        if (count > 0) {
+            errnum = data_md5(f, fingerprint, md5);
+        }
+
+        for (size_t i = 0; i < count && errnum == 0 && !found; ++ i) {
+            if (memcmp(md5, candidates[i]->md5, sizeof(md5)) == 0) {
+                *record   = candidates[i]->record;
+                *original = candidates[i]->filename;
+                *status   = candidates[i]->status;
+                found = 1;
+            }
+        }
+    }
+
+    if (fseek(f, 0, SEEK_SET) != 0 && errnum == 0) {
+        errnum = errno;
+    }
+
+    return found ? 0 : errnum == 0 ? ENOENT : errnum;
+}
+
+static int grow(struct ripcheck_duplicates *dups)
+{
+    const size_t bucket_count = dups->bucket_count * 2;
+    struct duplicate_entry **buckets = calloc(bucket_count, sizeof(struct duplicate_entry*));
+
+    if (!buckets) {
+        return errno;
+    }
+
+    for (size_t i = 0; i < dups->bucket_count; ++ i) {
+        struct duplicate_entry *entry = dups->buckets[i];
+
+        while (entry) {
+            struct duplicate_entry *next = entry->next;
+            const size_t index = fingerprint_hash(&entry->fingerprint) % bucket_count;
+
+            entry->next = buckets[index];
+            buckets[index] = entry;
+            entry = next;
+        }
+    }
+
+    free(dups->buckets);
+    dups->buckets      = buckets;
+    dups->bucket_count = bucket_count;
+
+    return 0;
+}
+
+int ripcheck_duplicates_add(
+    struct ripcheck_duplicates *dups,
+    const struct ripcheck_fingerprint *fingerprint,
+    const char *filename,
+    struct ripcheck_record *record,
+    int status)
+{
+    const struct ripcheck_checksums *checksums = ripcheck_record_checksums(record);
+
+    if (!fingerprint->valid || !checksums) {
+        ripcheck_record_free(record);
+        return EINVAL;
+    }
+
+    struct duplicate_entry *entry = calloc(1, sizeof(struct duplicate_entry));
+
+    if (!entry || !(entry->filename = strdup(filename))) {
+        int errnum = errno;
+        free(entry);
+        ripcheck_record_free(record);
+        return errnum;
+    }
+
+    // they were reported with the file and would be kept until the end
+    ripcheck_record_strip(record);
+
+    entry->fingerprint = *fingerprint;
+    entry->record      = record;
+    entry->status      = status;
+    memcpy(entry->md5, checksums->md5, sizeof(entry->md5));
+
+#ifdef WITH_THREADS
+    pthread_mutex_lock(&dups->mutex);
+#endif
+    // a failed resize only makes the chains longer
+    if (dups->count >= dups->bucket_count) {
+        grow(dups);
+    }
+
+    const size_t index = fingerprint_hash(fingerprint) % dups->bucket_count;
+    entry->next = dups->buckets[index];
+    dups->buckets[index] = entry;
+    ++ dups->count;
+#ifdef WITH_THREADS
+    pthread_mutex_unlock(&dups->mutex);
+#endif
+
+    return 0;
+}
+
+void ripcheck_duplicates_free(struct ripcheck_duplicates *dups)
+{
+    if (!dups) return;
+
+    for (size_t i = 0; i < dups->bucket_count; ++ i) {
+        struct duplicate_entry *entry = dups->buckets[i];
+
+        while (entry) {
+            struct duplicate_entry *next = entry->next;
+            ripcheck_record_free(entry->record);
+            free(entry->filename);
+            free(entry);
+            entry = next;
+        }
+    }
+
+#ifdef WITH_THREADS
+    pthread_mutex_destroy(&dups->mutex);
+#endif
+
+    free(dups->buckets);
+    free(dups);
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
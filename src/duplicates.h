@@ -0,0 +1,66 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_DUPLICATES_H__
+#define RIPCHECK_DUPLICATES_H__
+
+#include "ripcheck.h"
+#include "record.h"
+
+// cheap fingerprint of the audio data of a file
+struct ripcheck_fingerprint {
+    int      valid;
+    struct wave_fmt fmt;
+    uint32_t data_size;
+    long     data_offset;
+    // CRC32 of a few blocks spread over the data chunk
+    uint32_t crc32;
+};
+
+struct ripcheck_duplicates;
+
+int ripcheck_duplicates_create(struct ripcheck_duplicates **dups);
+
+// Find an earlier file with identical audio data. Files with a matching
+// fingerprint are confirmed by comparing the MD5 of their data chunks. On a
+// hit 0 is returned, *record and *original stay valid as long as dups and
+// *status is what ripcheck() returned for the original file. Returns ENOENT
+// otherwise. In any case f is rewound afterwards.
+int ripcheck_duplicates_lookup(
+    struct ripcheck_duplicates *dups,
+    FILE *f,
+    struct ripcheck_fingerprint *fingerprint,
+    const struct ripcheck_record **record,
+    const char **original,
+    int *status);
+
+// Add the result of a checked file. The record has to contain checksums.
+// dups takes ownership of record. The waveform pyramid, statistics and
+// spectrum are dropped from it, so the index only grows by the events.
+int ripcheck_duplicates_add(
+    struct ripcheck_duplicates *dups,
+    const struct ripcheck_fingerprint *fingerprint,
+    const char *filename,
+    struct ripcheck_record *record,
+    int status);
+
+void ripcheck_duplicates_free(struct ripcheck_duplicates *dups);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
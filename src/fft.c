@@ -0,0 +1,188 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fft.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+// cos and sin of pi / 2^m, so there is no need for libm
+static const double half_turns[][2] = {
+    { -1.0, 0.0 },
+    { 0.0, 1.0 },
+    { 0.7071067811865476, 0.7071067811865475 },
+    { 0.9238795325112867, 0.3826834323650898 },
+    { 0.9807852804032304, 0.19509032201612825 },
+    { 0.9951847266721969, 0.0980171403295606 },
+    { 0.9987954562051724, 0.049067674327418015 },
+    { 0.9996988186962042, 0.024541228522912288 },
+    { 0.9999247018391445, 0.012271538285719925 },
+    { 0.9999811752826011, 0.006135884649154475 },
+    { 0.9999952938095762, 0.003067956762965976 },
+    { 0.9999988234517019, 0.0015339801862847655 },
+    { 0.9999997058628822, 0.0007669903187427045 },
+    { 0.9999999264657179, 0.00038349518757139556 },
+    { 0.9999999816164293, 0.0001917475973107033 },
+    { 0.9999999954041073, 9.587379909597734e-05 },
+    { 0.9999999988510269, 4.793689960306688e-05 },
+    { 0.9999999997127567, 2.396844980841822e-05 },
+    { 0.9999999999281892, 1.1984224905069705e-05 },
+    { 0.9999999999820472, 5.9921124526424275e-06 },
+    { 0.9999999999955118, 2.996056226334661e-06 },
+    { 0.999999999998878, 1.4980281131690111e-06 },
+    { 0.9999999999997194, 7.490140565847157e-07 },
+    { 0.9999999999999298, 3.7450702829238413e-07 },
+    { 0.9999999999999825, 1.8725351414619535e-07 },
+    { 0.9999999999999957, 9.362675707309808e-08 },
+    { 0.9999999999999989, 4.681337853654909e-08 },
+    { 0.9999999999999998, 2.340668926827455e-08 },
+    { 0.9999999999999999, 1.1703344634137277e-08 },
+    { 1.0, 5.8516723170686385e-09 },
+    { 1.0, 2.9258361585343192e-09 },
+    { 1.0, 1.4629180792671596e-09 }
+};
+
+#define MAX_BITS (sizeof(half_turns) / sizeof(half_turns[0]))
+
+int ripcheck_fft_init(struct ripcheck_fft *fft, size_t size)
+{
+    unsigned int bits = 0;
+
+    while ((size >> bits) > 1)
+    {
+        ++ bits;
+    }
+
+    if (bits == 0 || bits > MAX_BITS || ((size_t)1 << bits) != size)
+    {
+        return EINVAL;
+    }
+
+    const size_t half = size / 2;
+    double *table = malloc(sizeof(double) * 2 * half);
+
+    if (!table)
+    {
+        return errno;
+    }
+
+    fft->size = size;
+    fft->bits = bits;
+    fft->cos  = table;
+    fft->sin  = table + half;
+
+    // exp(-2 pi i k / size) is the product of exp(-2 pi i 2^j / size) for
+    // the bits j of k, so no factor is off by more than bits roundings
+    fft->cos[0] = 1.0;
+    fft->sin[0] = 0.0;
+
+    for (unsigned int bit = 0; ((size_t)1 << bit) < half; ++ bit)
+    {
+        const size_t step = (size_t)1 << bit;
+        const double c =  half_turns[bits - 1 - bit][0];
+        const double s = -half_turns[bits - 1 - bit][1];
+
+        for (size_t k = 0; k < step; ++ k)
+        {
+            fft->cos[step + k] = fft->cos[k] * c - fft->sin[k] * s;
+            fft->sin[step + k] = fft->cos[k] * s + fft->sin[k] * c;
+        }
+    }
+
+    return 0;
+}
+
+static size_t reverse(size_t value, unsigned int bits)
+{
+    size_t reversed = 0;
+
+    for (unsigned int bit = 0; bit < bits; ++ bit)
+    {
+        reversed = (reversed << 1) | ((value >> bit) & 1);
+    }
+
+    return reversed;
+}
+
+void ripcheck_fft_forward(const struct ripcheck_fft *fft, double *re, double *im)
+{
+    const size_t size = fft->size;
+
+    for (size_t index = 0; index < size; ++ index)
+    {
+        const size_t other = reverse(index, fft->bits);
+
+        if (other > index)
+        {
+            double tmp;
+            tmp = re[index]; re[index] = re[other]; re[other] = tmp;
+            tmp = im[index]; im[index] = im[other]; im[other] = tmp;
+        }
+    }
+
+    for (size_t length = 2; length <= size; length *= 2)
+    {
+        const size_t half   = length / 2;
+        const size_t stride = size / length;
+
+        for (size_t first = 0; first < size; first += length)
+        {
+            double *re0 = re + first, *re1 = re0 + half;
+            double *im0 = im + first, *im1 = im0 + half;
+
+            for (size_t k = 0; k < half; ++ k)
+            {
+                const double c  = fft->cos[k * stride];
+                const double s  = fft->sin[k * stride];
+                const double tr = re1[k] * c - im1[k] * s;
+                const double ti = re1[k] * s + im1[k] * c;
+
+                re1[k] = re0[k] - tr;
+                im1[k] = im0[k] - ti;
+                re0[k] += tr;
+                im0[k] += ti;
+            }
+        }
+    }
+}
+
+// the inverse is the forward transform of the complex conjugate, conjugated
+void ripcheck_fft_inverse(const struct ripcheck_fft *fft, double *re, double *im)
+{
+    for (size_t index = 0; index < fft->size; ++ index)
+    {
+        im[index] = -im[index];
+    }
+
+    ripcheck_fft_forward(fft, re, im);
+
+    for (size_t index = 0; index < fft->size; ++ index)
+    {
+        im[index] = -im[index];
+    }
+}
+
+void ripcheck_fft_cleanup(struct ripcheck_fft *fft)
+{
+    free(fft->cos);
+    fft->cos  = NULL;
+    fft->sin  = NULL;
+    fft->size = 0;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
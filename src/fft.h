@@ -0,0 +1,46 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_FFT_H__
+#define RIPCHECK_FFT_H__
+
+#include <stddef.h>
+
+// Twiddle factors of an in place radix-2 FFT of a fixed size.
+struct ripcheck_fft {
+    size_t size;
+    unsigned int bits;
+    // exp(-2 pi i k / size) for k < size / 2
+    double *cos;
+    double *sin;
+};
+
+// size has to be a power of two from 2 to 2^32.
+int ripcheck_fft_init(struct ripcheck_fft *fft, size_t size);
+
+// Transform size complex values given as separate real and imaginary parts.
+void ripcheck_fft_forward(const struct ripcheck_fft *fft, double *re, double *im);
+
+// Inverse transform, not scaled by 1 / size.
+void ripcheck_fft_inverse(const struct ripcheck_fft *fft, double *re, double *im);
+
+void ripcheck_fft_cleanup(struct ripcheck_fft *fft);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,802 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN16) && !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_OPENAT
+#endif
+
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+
+// The manifest is read ahead by a thread that waits for input with poll(),
+// so that file_list_free() can wake it through a pipe.
+#if defined(WITH_THREADS) && defined(HAVE_OPENAT)
+#include <poll.h>
+#define HAVE_MANIFEST_THREAD
+#endif
+
+#include "file_list.h"
+
+// number of manifest entries that are read ahead
+#define MANIFEST_AHEAD 64
+
+struct file_entry {
+    char    *path;
+    uint64_t size;
+    size_t   seq;
+};
+
+struct file_list {
+    // explicitly given files
+    char  **files;
+    size_t  file_count;
+    size_t  file_index;
+
+    // list of files that is read while files are requested, NULL once it
+    // is read to the end
+    FILE   *manifest;
+    int     delim;
+    // ring of entries that the reader thread read ahead
+    char   *lines[MANIFEST_AHEAD];
+    size_t  line_first;
+    size_t  line_count;
+    // error reading the manifest, returned by file_list_next() once
+    int     manifest_errnum;
+    // the reader thread is reading the manifest, nobody else may
+    int     reading;
+
+    char  **extensions;
+    size_t  extension_count;
+
+    // stack of directories that still need to be walked
+    char  **dirs;
+    size_t  dir_count;
+    size_t  dir_capacity;
+
+    // max-heap of found files, ordered by size
+    struct file_entry *heap;
+    size_t  heap_count;
+    size_t  heap_capacity;
+    size_t  seq;
+
+    // number of walkers currently reading a directory
+    size_t  active;
+    int     stop;
+
+#ifdef WITH_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t      *threads;
+    size_t          thread_count;
+#endif
+#ifdef HAVE_MANIFEST_THREAD
+    pthread_t       reader;
+    int             have_reader;
+    // closing the write end wakes the reader thread
+    int             wake[2];
+#endif
+};
+
+static void list_lock(struct file_list *list)
+{
+#ifdef WITH_THREADS
+    pthread_mutex_lock(&list->mutex);
+#else
+    (void)list;
+#endif
+}
+
+static void list_unlock(struct file_list *list)
+{
+#ifdef WITH_THREADS
+    pthread_mutex_unlock(&list->mutex);
+#else
+    (void)list;
+#endif
+}
+
+static void list_notify(struct file_list *list)
+{
+#ifdef WITH_THREADS
+    pthread_cond_broadcast(&list->cond);
+#else
+    (void)list;
+#endif
+}
+
+struct file_list *file_list_create(void)
+{
+    struct file_list *list = calloc(1, sizeof(struct file_list));
+
+    if (!list) {
+        return NULL;
+    }
+
+    if (file_list_set_extensions(list, RIPCHECK_DEFAULT_EXTENSIONS) != 0) {
+        free(list);
+        return NULL;
+    }
+
+#ifdef WITH_THREADS
+    pthread_mutex_init(&list->mutex, NULL);
+    pthread_cond_init(&list->cond, NULL);
+#endif
+
+    return list;
+}
+
+void file_list_add_files(struct file_list *list, char **files, size_t count)
+{
+    list->files      = files;
+    list->file_count = count;
+    list->file_index = 0;
+}
+
+void file_list_set_manifest(struct file_list *list, FILE *manifest, int delim)
+{
+    list->manifest = manifest;
+    list->delim    = delim;
+}
+
+// Returns the next character of the manifest, or EOF at its end or on an
+// error, which is stored in *errnum.
+typedef int (*manifest_getc)(void *source, int *errnum);
+
+static int file_getc(void *source, int *errnum)
+{
+    FILE *manifest = (FILE *)source;
+    int ch = getc(manifest);
+
+    if (ch == EOF) {
+        *errnum = ferror(manifest) ? errno : 0;
+    }
+
+    return ch;
+}
+
+#ifdef HAVE_MANIFEST_THREAD
+// The file descriptor of the manifest, read by the reader thread only.
+struct manifest_reader {
+    int    fd;
+    int    wake_fd;
+    size_t pos;
+    size_t len;
+    char   buf[4096];
+};
+
+// Waits for input of the manifest or for wake_fd, which yields ECANCELED.
+static int reader_getc(void *source, int *errnum)
+{
+    struct manifest_reader *reader = (struct manifest_reader *)source;
+
+    while (reader->pos == reader->len) {
+        struct pollfd fds[2] = {
+            { reader->fd,      POLLIN, 0 },
+            { reader->wake_fd, POLLIN, 0 }
+        };
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *errnum = errno;
+            return EOF;
+        }
+
+        if (fds[1].revents) {
+            *errnum = ECANCELED;
+            return EOF;
+        }
+
+        ssize_t count = read(reader->fd, reader->buf, sizeof(reader->buf));
+
+        if (count <= 0) {
+            if (count < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            *errnum = count < 0 ? errno : 0;
+            return EOF;
+        }
+
+        reader->pos = 0;
+        reader->len = (size_t)count;
+    }
+
+    return (unsigned char)reader->buf[reader->pos ++];
+}
+#endif
+
+// Read the next non-empty entry of the manifest. Returns ENOENT at its end.
+// This may block, so it is never called with the list locked by a thread.
+static int read_manifest(manifest_getc next, void *source, int delim, char **filename)
+{
+    char  *buf  = NULL;
+    size_t size = 0;
+    size_t len  = 0;
+
+    for (;;) {
+        int errnum = 0;
+        int ch = next(source, &errnum);
+
+        if (ch == EOF || ch == delim) {
+            if (ch == EOF) {
+                if (errnum != 0 || len == 0) {
+                    free(buf);
+                    return errnum != 0 ? errnum : ENOENT;
+                }
+            }
+            else if (len == 0) {
+                continue;
+            }
+
+            buf[len] = '\0';
+            *filename = buf;
+            return 0;
+        }
+
+        if (len + 1 >= size) {
+            size_t new_size = size ? size * 2 : 256;
+            char *new_buf = realloc(buf, new_size);
+
+            if (!new_buf) {
+                int errnum = errno;
+                free(buf);
+                return errnum;
+            }
+
+            buf  = new_buf;
+            size = new_size;
+        }
+
+        buf[len ++] = (char)ch;
+    }
+}
+
+int file_list_set_extensions(struct file_list *list, const char *extensions)
+{
+    size_t count = 1;
+    for (const char *ptr = extensions; *ptr; ++ ptr) {
+        if (*ptr == ',') ++ count;
+    }
+
+    char **exts = calloc(count, sizeof(char*));
+    if (!exts) {
+        return errno;
+    }
+
+    const char *from = extensions;
+    for (size_t i = 0; i < count; ++ i) {
+        const char *to = strchr(from, ',');
+        if (!to) to = from + strlen(from);
+
+        // allow ".wav" as well as "wav"
+        if (*from == '.' && from < to) ++ from;
+
+        exts[i] = strndup(from, to - from);
+        if (!exts[i]) {
+            int errnum = errno;
+            for (size_t j = 0; j < i; ++ j) free(exts[j]);
+            free(exts);
+            return errnum;
+        }
+        from = to + 1;
+    }
+
+    for (size_t i = 0; i < list->extension_count; ++ i) {
+        free(list->extensions[i]);
+    }
+    free(list->extensions);
+
+    list->extensions      = exts;
+    list->extension_count = count;
+
+    return 0;
+}
+
+static int push_directory(struct file_list *list, char *path)
+{
+    if (list->dir_count == list->dir_capacity) {
+        size_t capacity = list->dir_capacity ? list->dir_capacity * 2 : 16;
+        char **dirs = realloc(list->dirs, capacity * sizeof(char*));
+
+        if (!dirs) {
+            return errno;
+        }
+
+        list->dirs = dirs;
+        list->dir_capacity = capacity;
+    }
+
+    list->dirs[list->dir_count ++] = path;
+
+    return 0;
+}
+
+int file_list_add_directory(struct file_list *list, const char *path)
+{
+    char *copy = strdup(path);
+
+    if (!copy) {
+        return errno;
+    }
+
+    int errnum = push_directory(list, copy);
+    if (errnum != 0) {
+        free(copy);
+    }
+
+    return errnum;
+}
+
+int file_list_has_directories(const struct file_list *list)
+{
+    return list->dir_count > 0;
+}
+
+static int entry_less(const struct file_entry *a, const struct file_entry *b)
+{
+    return a->size < b->size || (a->size == b->size && a->seq > b->seq);
+}
+
+static int push_file(struct file_list *list, char *path, uint64_t size)
+{
+    if (list->heap_count == list->heap_capacity) {
+        size_t capacity = list->heap_capacity ? list->heap_capacity * 2 : 64;
+        struct file_entry *heap = realloc(list->heap, capacity * sizeof(struct file_entry));
+
+        if (!heap) {
+            return errno;
+        }
+
+        list->heap = heap;
+        list->heap_capacity = capacity;
+    }
+
+    struct file_entry entry = { path, size, list->seq ++ };
+    size_t index = list->heap_count ++;
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!entry_less(&list->heap[parent], &entry)) break;
+        list->heap[index] = list->heap[parent];
+        index = parent;
+    }
+    list->heap[index] = entry;
+
+    return 0;
+}
+
+static char *pop_file(struct file_list *list)
+{
+    char *path = list->heap[0].path;
+    struct file_entry last = list->heap[-- list->heap_count];
+    size_t index = 0;
+
+    for (;;) {
+        size_t child = index * 2 + 1;
+        if (child >= list->heap_count) break;
+        if (child + 1 < list->heap_count && entry_less(&list->heap[child], &list->heap[child + 1])) {
+            ++ child;
+        }
+        if (!entry_less(&last, &list->heap[child])) break;
+        list->heap[index] = list->heap[child];
+        index = child;
+    }
+
+    if (list->heap_count > 0) {
+        list->heap[index] = last;
+    }
+
+    return path;
+}
+
+static int has_extension(const struct file_list *list, const char *name)
+{
+    const char *ext = strrchr(name, '.');
+
+    if (!ext || ext == name) {
+        return 0;
+    }
+
+    ++ ext;
+    for (size_t i = 0; i < list->extension_count; ++ i) {
+        if (strcasecmp(ext, list->extensions[i]) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    const size_t dirlen  = strlen(dir);
+    const size_t namelen = strlen(name);
+    const int    slash   = dirlen > 0 && dir[dirlen - 1] != '/';
+    char *path = malloc(dirlen + slash + namelen + 1);
+
+    if (path) {
+        memcpy(path, dir, dirlen);
+        if (slash) path[dirlen] = '/';
+        memcpy(path + dirlen + slash, name, namelen + 1);
+    }
+
+    return path;
+}
+
+// read one directory and add its files and sub-directories to the list
+static void walk_directory(struct file_list *list, const char *path)
+{
+#ifdef HAVE_OPENAT
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd < 0 ? NULL : fdopendir(fd);
+
+    if (!dir && fd >= 0) {
+        close(fd);
+    }
+#else
+    DIR *dir = opendir(path);
+#endif
+
+    if (!dir) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const char *name = entry->d_name;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        struct stat st;
+        int isdir  = 0;
+        int isfile = 0;
+
+#if defined(HAVE_OPENAT) && defined(_DIRENT_HAVE_D_TYPE)
+        // avoid a stat() for every sub-directory and every file we don't want
+        if (entry->d_type == DT_DIR) {
+            isdir = 1;
+        }
+        else if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) {
+            continue;
+        }
+        else if (!has_extension(list, name)) {
+            if (entry->d_type != DT_UNKNOWN) {
+                continue;
+            }
+        }
+#endif
+
+        char *child = join_path(path, name);
+        if (!child) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            continue;
+        }
+
+        if (!isdir) {
+#ifdef HAVE_OPENAT
+            // directories behind symbolic links are not followed to avoid loops
+            if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode) &&
+                fstatat(dirfd(dir), name, &st, 0) == 0 && S_ISDIR(st.st_mode)) {
+                free(child);
+                continue;
+            }
+            else if (fstatat(dirfd(dir), name, &st, 0) != 0) {
+#else
+            if (stat(child, &st) != 0) {
+#endif
+                fprintf(stderr, "%s: %s\n", child, strerror(errno));
+                free(child);
+                continue;
+            }
+
+            isdir  = S_ISDIR(st.st_mode);
+            isfile = S_ISREG(st.st_mode) && has_extension(list, name);
+        }
+
+        int errnum = 0;
+        if (isdir) {
+            list_lock(list);
+            errnum = push_directory(list, child);
+            list_notify(list);
+            list_unlock(list);
+        }
+        else if (isfile) {
+            list_lock(list);
+            errnum = push_file(list, child, st.st_size);
+            list_notify(list);
+            list_unlock(list);
+        }
+        else {
+            free(child);
+            continue;
+        }
+
+        if (errnum != 0) {
+            fprintf(stderr, "%s: %s\n", child, strerror(errnum));
+            free(child);
+        }
+    }
+
+    closedir(dir);
+}
+
+// take directories from the stack until all are walked
+// has to be called with the list locked
+static void walk(struct file_list *list)
+{
+    for (;;) {
+#ifdef WITH_THREADS
+        while (list->dir_count == 0 && list->active > 0) {
+            pthread_cond_wait(&list->cond, &list->mutex);
+        }
+#endif
+
+        if (list->dir_count == 0 || list->stop) {
+            list_notify(list);
+            break;
+        }
+
+        char *path = list->dirs[-- list->dir_count];
+        ++ list->active;
+        list_unlock(list);
+
+        walk_directory(list, path);
+        free(path);
+
+        list_lock(list);
+        -- list->active;
+        if (list->active == 0 && list->dir_count == 0) {
+            list_notify(list);
+        }
+    }
+}
+
+#ifdef HAVE_MANIFEST_THREAD
+// Read the manifest ahead into the ring without holding the lock, so a slow
+// producer only holds up the callers that wait for its entries.
+static void *manifest_thread(void *ptr)
+{
+    struct file_list *list = (struct file_list *)ptr;
+    // not changed by anyone else while reading is set
+    struct manifest_reader reader = { fileno(list->manifest), list->wake[0], 0, 0, { 0 } };
+    const int delim = list->delim;
+
+    for (;;) {
+        char *filename = NULL;
+        int errnum = read_manifest(reader_getc, &reader, delim, &filename);
+
+        list_lock(list);
+        while (errnum == 0 && list->line_count == MANIFEST_AHEAD && !list->stop) {
+            pthread_cond_wait(&list->cond, &list->mutex);
+        }
+
+        if (errnum != 0 || list->stop) {
+            free(filename);
+            if (errnum != ENOENT) {
+                list->manifest_errnum = errnum;
+            }
+            list->manifest = NULL;
+            list->reading  = 0;
+            list_notify(list);
+            list_unlock(list);
+            break;
+        }
+
+        list->lines[(list->line_first + list->line_count) % MANIFEST_AHEAD] = filename;
+        ++ list->line_count;
+        list_notify(list);
+        list_unlock(list);
+    }
+
+    return NULL;
+}
+#endif
+
+#ifdef WITH_THREADS
+static void *walk_thread(void *ptr)
+{
+    struct file_list *list = (struct file_list *)ptr;
+
+    list_lock(list);
+    walk(list);
+    list_unlock(list);
+
+    return NULL;
+}
+#endif
+
+int file_list_start(struct file_list *list, size_t walk_threads)
+{
+#ifdef HAVE_MANIFEST_THREAD
+    // without the thread the manifest is read by file_list_next()
+    if (list->manifest && pipe(list->wake) == 0) {
+        list->reading = 1;
+        list->have_reader = pthread_create(&list->reader, NULL, manifest_thread, list) == 0;
+
+        if (!list->have_reader) {
+            list->reading = 0;
+            close(list->wake[0]);
+            close(list->wake[1]);
+        }
+    }
+#endif
+
+    if (list->dir_count == 0) {
+        return 0;
+    }
+
+#ifdef WITH_THREADS
+    list->threads = calloc(walk_threads, sizeof(pthread_t));
+
+    if (!list->threads) {
+        return errno;
+    }
+
+    for (; list->thread_count < walk_threads; ++ list->thread_count) {
+        int errnum = pthread_create(&list->threads[list->thread_count], NULL, walk_thread, list);
+
+        if (errnum != 0) {
+            if (list->thread_count == 0) {
+                return errnum;
+            }
+            break;
+        }
+    }
+#else
+    (void)walk_threads;
+    walk(list);
+#endif
+
+    return 0;
+}
+
+int file_list_next(struct file_list *list, char **filename, int wait)
+{
+    int errnum = 0;
+
+    *filename = NULL;
+
+    list_lock(list);
+
+    if (list->file_index < list->file_count) {
+        *filename = strdup(list->files[list->file_index ++]);
+
+        if (!*filename) {
+            errnum = errno;
+        }
+    }
+
+    // the entries of the manifest come before the files in the directories
+    while (!*filename && errnum == 0) {
+        if (list->line_count > 0) {
+            *filename = list->lines[list->line_first];
+            list->line_first = (list->line_first + 1) % MANIFEST_AHEAD;
+            -- list->line_count;
+            // there is room for the reader again
+            list_notify(list);
+            break;
+        }
+        else if (list->manifest_errnum != 0) {
+            errnum = list->manifest_errnum;
+            list->manifest_errnum = 0;
+            break;
+        }
+        else if (list->manifest && !list->reading) {
+            errnum = read_manifest(file_getc, list->manifest, list->delim, filename);
+
+            if (errnum != 0) {
+                list->manifest = NULL;
+                errnum = errnum == ENOENT ? 0 : errnum;
+            }
+            continue;
+        }
+        else if (!list->reading) {
+            if (list->heap_count > 0) {
+                *filename = pop_file(list);
+                break;
+            }
+            else if (list->dir_count == 0 && list->active == 0) {
+                errnum = ENOENT;
+                break;
+            }
+        }
+
+        if (!wait) {
+            errnum = EAGAIN;
+            break;
+        }
+#ifdef WITH_THREADS
+        pthread_cond_wait(&list->cond, &list->mutex);
+#endif
+    }
+
+    list_unlock(list);
+
+    return errnum;
+}
+
+void file_list_free(struct file_list *list)
+{
+#ifdef HAVE_MANIFEST_THREAD
+    if (list->have_reader) {
+        list_lock(list);
+        list->stop = 1;
+        list_notify(list);
+        list_unlock(list);
+
+        // it might wait for the producer of the manifest forever
+        close(list->wake[1]);
+        pthread_join(list->reader, NULL);
+        close(list->wake[0]);
+    }
+#endif
+
+#ifdef WITH_THREADS
+    if (list->thread_count > 0) {
+        // stop walking
+        list_lock(list);
+        list->stop = 1;
+        list_notify(list);
+        list_unlock(list);
+
+        for (size_t i = 0; i < list->thread_count; ++ i) {
+            pthread_join(list->threads[i], NULL);
+        }
+    }
+    free(list->threads);
+    pthread_mutex_destroy(&list->mutex);
+    pthread_cond_destroy(&list->cond);
+#endif
+
+    while (list->dir_count > 0) {
+        free(list->dirs[-- list->dir_count]);
+    }
+
+    while (list->heap_count > 0) {
+        free(list->heap[-- list->heap_count].path);
+    }
+
+    for (; list->line_count > 0; -- list->line_count) {
+        free(list->lines[list->line_first]);
+        list->line_first = (list->line_first + 1) % MANIFEST_AHEAD;
+    }
+
+    for (size_t i = 0; i < list->extension_count; ++ i) {
+        free(list->extensions[i]);
+    }
+
+    free(list->extensions);
+    free(list->dirs);
+    free(list->heap);
+    free(list);
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
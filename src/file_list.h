@@ -0,0 +1,64 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_FILE_LIST_H__
+#define RIPCHECK_FILE_LIST_H__
+
+#include "ripcheck.h"
+
+#define RIPCHECK_WALK_THREADS (size_t)4
+#define RIPCHECK_DEFAULT_EXTENSIONS "wav"
+
+struct file_list;
+
+struct file_list *file_list_create(void);
+
+// Files given explicitly are returned first and in the given order.
+// The strings have to stay valid as long as the list is used.
+void file_list_add_files(struct file_list *list, char **files, size_t count);
+
+// Files listed in manifest, separated by delim, are returned after the files
+// given explicitly. If compiled with thread support the manifest is read
+// ahead a limited number of entries by a thread started by file_list_start(),
+// otherwise it is read only as far as files are requested.
+void file_list_set_manifest(struct file_list *list, FILE *manifest, int delim);
+
+// Comma separated list of file name extensions of the files that are
+// collected when walking directories.
+int file_list_set_extensions(struct file_list *list, const char *extensions);
+
+int file_list_add_directory(struct file_list *list, const char *path);
+
+int file_list_has_directories(const struct file_list *list);
+
+// Start walking the directories. If compiled with thread support this is
+// done by walk_threads threads in the background, otherwise the directories
+// are walked right away.
+int file_list_start(struct file_list *list, size_t walk_threads);
+
+// Get the next file. The biggest files found so far in the directories are
+// returned first. *filename has to be freed by the caller. Returns ENOENT if
+// there are no more files and EAGAIN if wait is 0 and neither the manifest
+// reader nor the directory walk have a file yet. Safe to call from multiple threads.
+int file_list_next(struct file_list *list, char **filename, int wait);
+
+void file_list_free(struct file_list *list);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,343 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "image_sink.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef WITH_PNG
+#   include <png.h>
+#endif
+
+// ---- raster sinks: RGB pixels, 3 bytes per pixel ----
+
+static int raster_init(struct ripcheck_canvas *canvas)
+{
+    canvas->data = malloc(canvas->width * canvas->height * 3);
+
+    return canvas->data ? 0 : errno;
+}
+
+static void raster_fill_rect(struct ripcheck_canvas *canvas,
+    size_t x1, size_t y1, size_t x2, size_t y2,
+    const uint8_t color[3])
+{
+    uint8_t *pixels = canvas->data;
+    const uint8_t r = color[0];
+    const uint8_t g = color[1];
+    const uint8_t b = color[2];
+
+    for (size_t y = y1; y <= y2; ++ y) {
+        uint8_t *row = pixels + y * canvas->width * 3;
+        for (size_t x = x1; x <= x2; ++ x) {
+            size_t i = 3 * x;
+            row[i + 0] = r;
+            row[i + 1] = g;
+            row[i + 2] = b;
+        }
+    }
+}
+
+static void raster_cleanup(struct ripcheck_canvas *canvas)
+{
+    free(canvas->data);
+    canvas->data = NULL;
+}
+
+#ifdef WITH_PNG
+static int png_write(const struct ripcheck_canvas *canvas, FILE *f)
+{
+    png_structp png = NULL;
+    png_infop info  = NULL;
+    const uint8_t *pixels = canvas->data;
+    volatile int errnum = 0;
+
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+
+    if (!png) {
+        return ENOMEM;
+    }
+
+    info = png_create_info_struct(png);
+
+    if (!info) {
+        errnum = ENOMEM;
+        goto finalize;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        errnum = errno ? errno : EIO;
+        goto finalize;
+    }
+
+    png_init_io(png, f);
+
+    // write header (8 bit color depth)
+    png_set_IHDR(png, info, canvas->width, canvas->height,
+        8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+    png_write_info(png, info);
+    for (size_t y = 0; y < canvas->height; ++ y) {
+        png_write_row(png, (png_const_bytep)(pixels + y * canvas->width * 3));
+    }
+    png_write_end(png, NULL);
+
+finalize:
+    png_destroy_write_struct(&png, info ? &info : NULL);
+
+    return errnum;
+}
+
+static const struct ripcheck_image_sink png_sink = {
+    "png", "png", raster_init, raster_fill_rect, png_write, raster_cleanup
+};
+#endif
+
+// binary PPM (P6) is just a tiny header followed by the raw RGB pixels
+static int ppm_write(const struct ripcheck_canvas *canvas, FILE *f)
+{
+    if (fprintf(f, "P6\n%"PRIuMAX" %"PRIuMAX"\n255\n",
+            (uintmax_t)canvas->width, (uintmax_t)canvas->height) < 0) {
+        return errno;
+    }
+
+    const size_t size = canvas->width * canvas->height * 3;
+    if (fwrite(canvas->data, 1, size, f) != size) {
+        return errno ? errno : EIO;
+    }
+
+    return 0;
+}
+
+static const struct ripcheck_image_sink ppm_sink = {
+    "ppm", "ppm", raster_init, raster_fill_rect, ppm_write, raster_cleanup
+};
+
+// ---- SVG sink: one <path> per run of rectangles with the same color ----
+
+struct svg_rect {
+    size_t  x;
+    size_t  y;
+    size_t  width;
+    size_t  height;
+    uint8_t color[3];
+};
+
+static int svg_init(struct ripcheck_canvas *canvas)
+{
+    canvas->data     = NULL;
+    canvas->count    = 0;
+    canvas->capacity = 0;
+
+    return 0;
+}
+
+static void svg_fill_rect(struct ripcheck_canvas *canvas,
+    size_t x1, size_t y1, size_t x2, size_t y2,
+    const uint8_t color[3])
+{
+    struct svg_rect *rects = canvas->data;
+
+    // a rectangle covering the whole image hides everything drawn before
+    if (x1 == 0 && y1 == 0 && x2 + 1 >= canvas->width && y2 + 1 >= canvas->height) {
+        canvas->count = 0;
+    }
+    else if (canvas->count > 0) {
+        // extend the previous rectangle if this one continues it to the right
+        struct svg_rect *last = &rects[canvas->count - 1];
+        if (last->y == y1 && last->height == y2 - y1 + 1 && last->x + last->width == x1 &&
+                memcmp(last->color, color, 3) == 0) {
+            last->width += x2 - x1 + 1;
+            return;
+        }
+    }
+
+    if (canvas->count == canvas->capacity) {
+        size_t capacity = canvas->capacity ? canvas->capacity * 2 : 64;
+        rects = realloc(rects, capacity * sizeof(struct svg_rect));
+
+        if (!rects) {
+            // the image is written without this rectangle
+            return;
+        }
+
+        canvas->data     = rects;
+        canvas->capacity = capacity;
+    }
+
+    struct svg_rect *rect = &rects[canvas->count ++];
+    rect->x        = x1;
+    rect->y        = y1;
+    rect->width    = x2 - x1 + 1;
+    rect->height   = y2 - y1 + 1;
+    rect->color[0] = color[0];
+    rect->color[1] = color[1];
+    rect->color[2] = color[2];
+}
+
+static int svg_write(const struct ripcheck_canvas *canvas, FILE *f)
+{
+    const struct svg_rect *rects = canvas->data;
+
+    fprintf(f,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%"PRIuMAX"\" height=\"%"PRIuMAX"\" "
+        "shape-rendering=\"crispEdges\">\n",
+        (uintmax_t)canvas->width, (uintmax_t)canvas->height);
+
+    for (size_t i = 0; i < canvas->count;) {
+        const struct svg_rect *first = &rects[i];
+        size_t end = i + 1;
+
+        // rectangles are painted in order, so only consecutive ones are joined
+        while (end < canvas->count && memcmp(rects[end].color, first->color, 3) == 0) {
+            ++ end;
+        }
+
+        if (end - i == 1) {
+            fprintf(f, "<rect x=\"%"PRIuMAX"\" y=\"%"PRIuMAX"\" width=\"%"PRIuMAX"\" height=\"%"PRIuMAX"\" "
+                "fill=\"#%02X%02X%02X\"/>\n",
+                (uintmax_t)first->x, (uintmax_t)first->y, (uintmax_t)first->width, (uintmax_t)first->height,
+                first->color[0], first->color[1], first->color[2]);
+        }
+        else {
+            fprintf(f, "<path fill=\"#%02X%02X%02X\" d=\"",
+                first->color[0], first->color[1], first->color[2]);
+
+            for (; i < end; ++ i) {
+                const struct svg_rect *rect = &rects[i];
+                fprintf(f, "M%"PRIuMAX" %"PRIuMAX"h%"PRIuMAX"v%"PRIuMAX"h-%"PRIuMAX"z",
+                    (uintmax_t)rect->x, (uintmax_t)rect->y,
+                    (uintmax_t)rect->width, (uintmax_t)rect->height, (uintmax_t)rect->width);
+            }
+
+            fprintf(f, "\"/>\n");
+        }
+
+        i = end;
+    }
+
+    fprintf(f, "</svg>\n");
+
+    return ferror(f) ? (errno ? errno : EIO) : 0;
+}
+
+static void svg_cleanup(struct ripcheck_canvas *canvas)
+{
+    free(canvas->data);
+    canvas->data     = NULL;
+    canvas->count    = 0;
+    canvas->capacity = 0;
+}
+
+static const struct ripcheck_image_sink svg_sink = {
+    "svg", "svg", svg_init, svg_fill_rect, svg_write, svg_cleanup
+};
+
+const struct ripcheck_image_sink *ripcheck_image_sinks[] = {
+#ifdef WITH_PNG
+    &png_sink,
+#endif
+    &svg_sink,
+    &ppm_sink,
+    NULL
+};
+
+const struct ripcheck_image_sink *ripcheck_image_sink_by_name(const char *name)
+{
+    for (const struct ripcheck_image_sink **sink = ripcheck_image_sinks; *sink; ++ sink) {
+        if (strcasecmp((*sink)->name, name) == 0) {
+            return *sink;
+        }
+    }
+
+    return NULL;
+}
+
+int ripcheck_canvas_init(struct ripcheck_canvas *canvas,
+    const struct ripcheck_image_sink *sink,
+    size_t width, size_t height)
+{
+    canvas->sink     = sink;
+    canvas->width    = width;
+    canvas->height   = height;
+    canvas->data     = NULL;
+    canvas->count    = 0;
+    canvas->capacity = 0;
+
+    if (width == 0 || height == 0) {
+        return EINVAL;
+    }
+
+    return sink->init(canvas);
+}
+
+void ripcheck_canvas_fill_rect(struct ripcheck_canvas *canvas,
+    size_t x1, size_t y1, size_t x2, size_t y2,
+    const uint8_t color[3])
+{
+    if (x2 >= canvas->width)  x2 = canvas->width  - 1;
+    if (y2 >= canvas->height) y2 = canvas->height - 1;
+
+    if (x1 > x2 || y1 > y2) {
+        return;
+    }
+
+    canvas->sink->fill_rect(canvas, x1, y1, x2, y2, color);
+}
+
+int ripcheck_canvas_write(const struct ripcheck_canvas *canvas, const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+
+    if (!f) {
+        int errnum = errno;
+        perror(filename);
+        return errnum;
+    }
+
+    int errnum = canvas->sink->write(canvas, f);
+
+    if (fclose(f) != 0 && errnum == 0) {
+        errnum = errno;
+    }
+
+    if (errnum != 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errnum));
+        return errnum;
+    }
+
+    printf("written image: %s\n", filename);
+
+    return 0;
+}
+
+void ripcheck_canvas_cleanup(struct ripcheck_canvas *canvas)
+{
+    if (canvas->sink) {
+        canvas->sink->cleanup(canvas);
+    }
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
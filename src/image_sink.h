@@ -0,0 +1,75 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RIPCHECK_IMAGE_SINK_H__
+#define RIPCHECK_IMAGE_SINK_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct ripcheck_canvas;
+
+// An image format. Images are drawn only with filled rectangles, so raster
+// formats keep the pixels while vector formats keep the rectangles.
+struct ripcheck_image_sink {
+    const char *name;
+    const char *extension;
+
+    int  (*init)(struct ripcheck_canvas *canvas);
+    void (*fill_rect)(struct ripcheck_canvas *canvas,
+        size_t x1, size_t y1, size_t x2, size_t y2,
+        const uint8_t color[3]);
+    int  (*write)(const struct ripcheck_canvas *canvas, FILE *f);
+    void (*cleanup)(struct ripcheck_canvas *canvas);
+};
+
+struct ripcheck_canvas {
+    const struct ripcheck_image_sink *sink;
+    size_t width;
+    size_t height;
+
+    // sink specific
+    void  *data;
+    size_t count;
+    size_t capacity;
+};
+
+// available sinks, NULL terminated, the first one is the default
+extern const struct ripcheck_image_sink *ripcheck_image_sinks[];
+
+const struct ripcheck_image_sink *ripcheck_image_sink_by_name(const char *name);
+
+int ripcheck_canvas_init(struct ripcheck_canvas *canvas,
+    const struct ripcheck_image_sink *sink,
+    size_t width, size_t height);
+
+// x2 and y2 are inclusive
+void ripcheck_canvas_fill_rect(struct ripcheck_canvas *canvas,
+    size_t x1, size_t y1, size_t x2, size_t y2,
+    const uint8_t color[3]);
+
+// writes the image and prints its name
+int ripcheck_canvas_write(const struct ripcheck_canvas *canvas, const char *filename);
+
+void ripcheck_canvas_cleanup(struct ripcheck_canvas *canvas);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
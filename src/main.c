@@ -21,6 +21,19 @@
 
 #include "ripcheck.h"
 #include "print_text.h"
+#include "batch_reader.h"
+#include "file_list.h"
+#include "record.h"
+#include "cache.h"
+#include "duplicates.h"
+#include "cue.h"
+#include "peaks.h"
+#include "detector.h"
+#include "compare.h"
+
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 
 #ifdef WITH_VISUALIZE
 #include "print_image.h"
@@ -42,6 +55,38 @@ const struct option long_options[] = {
     {"min-dupes",      required_argument, 0,  0 },
     {"window-size",    required_argument, 0, 'w'},
     {"image-filename", required_argument, 0,  0 },
+    {"io-depth",       required_argument, 0,  0 },
+    {"direct-io",      no_argument,       0,  0 },
+    {"recursive",      required_argument, 0, 'r'},
+    {"extensions",     required_argument, 0,  0 },
+    {"jobs",           required_argument, 0, 'j'},
+    {"files-from",     required_argument, 0,  0 },
+    {"null",           no_argument,       0, '0'},
+    {"cache",          optional_argument, 0,  0 },
+    {"cache-hash",     no_argument,       0,  0 },
+    {"checksums",      no_argument,       0,  0 },
+    {"duplicates",     no_argument,       0,  0 },
+    {"cue",            required_argument, 0,  0 },
+    {"triage",         no_argument,       0,  0 },
+    {"time-budget",    required_argument, 0,  0 },
+    {"start",          required_argument, 0,  0 },
+    {"end",            required_argument, 0,  0 },
+    {"peaks",          optional_argument, 0,  0 },
+    {"overview",       optional_argument, 0,  0 },
+    {"image-format",   required_argument, 0,  0 },
+    {"detectors",      required_argument, 0,  0 },
+    {"clip-limit",     required_argument, 0,  0 },
+    {"min-clipped",    required_argument, 0,  0 },
+    {"silence-limit",  required_argument, 0,  0 },
+    {"min-dropout",    required_argument, 0,  0 },
+    {"merge-channels", optional_argument, 0,  0 },
+    {"adaptive-limits", optional_argument, 0,  0 },
+    {"click-ratio",    required_argument, 0,  0 },
+    {"click-limit",    required_argument, 0,  0 },
+    {"compare",        no_argument,       0,  0 },
+    {"max-offset",     required_argument, 0,  0 },
+    {"stats",          no_argument,       0,  0 },
+    {"spectrum",       no_argument,       0,  0 },
     {0,                0,                 0,  0 }
 };
 
@@ -65,7 +110,7 @@ static int parse_size(const char *str, size_t *size)
 static void usage (int argc, char *argv[])
 {
     printf(
-        "Usage: %s [OPTIONS] [WAVE-FILE]...\n"
+        "Usage: %s [OPTIONS] [WAVE-FILE]... [-r DIRECTORY]...\n"
         "'ripcheck' runs a variety of tests on a PCM WAV file, to see if there are potential\n"
         "mistakes that occurred in converting a CD to a WAV file.\n"
         "\n"
@@ -81,7 +126,7 @@ static void usage (int argc, char *argv[])
 
 #ifdef WITH_VISUALIZE
     printf(
-        "  -V, --visualize[=PARAMS]      print wave forms around found problems to PNG images\n"
+        "  -V, --visualize[=PARAMS]      print wave forms around found problems to images\n"
         "                                PARAMS is a comma separated list of key-value pairs that\n"
         "                                define the size and color of the generated images.\n"
         "\n"
@@ -94,6 +139,10 @@ static void usage (int argc, char *argv[])
         "                                error-color=COLOR      color of the error sample (default: #FF2020)\n"
         "                                error-bg-color=COLOR   background color of the error sample\n"
         "                                                       (default: #FFC440)\n"
+        "                                overview-width=PIXELS  width of the overview image\n"
+        "                                                       (default: 1200)\n"
+        "                                overview-height=PIXELS height of a channel of the overview image\n"
+        "                                                       above the zero line (default: 40)\n"
         "\n"
         "                                COLOR may be a HTML like hexadecimal color string (e.g. #FFFFFF)\n"
         "                                or one of the 16 defined HTML color names (e.g. white).\n"
@@ -102,7 +151,8 @@ static void usage (int argc, char *argv[])
         "                                Patterns can reference certain variables using {VARNAME}.\n"
         "                                In order to put a { or } in the resulting filename write {{ or }}.\n"
         "\n"
-        "                                errorname           'pop', 'drop' or 'dupes'\n"
+        "                                errorname           'pop', 'drop', 'dupes', 'clipping',\n"
+        "                                                    'dropout' or 'click'\n"
         "                                filename            name of the WAV file without path\n"
         "                                basename            name of the WAV file without path or extension\n"
         "                                filepath            path of the WAV file\n"
@@ -114,15 +164,40 @@ static void usage (int argc, char *argv[])
         "                                first_window_sample first sample in current window\n"
         "                                last_window_sample  last sample in current window\n"
         "                                window_size         number of samples in window\n"
+        "                                extension           file name extension of the image format\n"
         "\n"
         "                                If the error happened at the very beginning of the WAV file then\n"
         "                                window_size might be bigger than what last_window_sample and\n"
         "                                first_window_sample imply.\n"
+        "\n"
+        "      --image-format=FORMAT     write images in FORMAT, one of:\n"
+        "\n"
+        "                                png   compressed, needs libpng (default if available)\n"
+        "                                svg   vector graphics, small for wave forms\n"
+        "                                ppm   uncompressed RGB (binary PPM) for other tools\n"
+        "\n"
+        "      --overview[=PARAMS]       print the wave form of the whole file with all found problems\n"
+        "                                marked to an image named {basename}_overview.{extension}. Takes\n"
+        "                                the same PARAMS as --visualize. The image is drawn from a\n"
+        "                                waveform pyramid that is built during the scan. Can't be\n"
+        "                                combined with --start or --time-budget.\n"
         "\n");
 #endif
     printf(
         "  -t, --max-time=TIME           stop analyzing at TIME\n"
+        "      --start=TIME              start analyzing at TIME\n"
+        "                                Seeks straight to TIME and only reads a few samples before\n"
+        "                                it to warm up. Can't be combined with --checksums or\n"
+        "                                --duplicates.\n"
+        "      --end=TIME                same as --max-time\n"
         "  -b, --max-bad-areas=COUNT     stop analyzing after COUNT problems found\n"
+        "      --triage                  only tell if a file is clean or suspect by stopping at\n"
+        "                                its first problem (same as --max-bad-areas=1)\n"
+        "      --time-budget=MS          analyze as much of a file as possible in MS milliseconds\n"
+        "                                The start and the end are analyzed first, then parts spread\n"
+        "                                evenly over the file. The analyzed parts are printed as\n"
+        "                                'covered' lines. Can't be combined with --checksums,\n"
+        "                                --duplicates or --cache.\n"
         "  -i, --intro-length=TIME       start analyzing at TIME (default: 5 sec)\n"
         "  -o, --outro-length=TIME       stop analyzing at TIME before end (default: 5 sec)\n"
         "  -p, --pop-limit=VOLUME        set the minimum volume of a pop to VOLUME (default: 33.333 %%)\n"
@@ -136,7 +211,109 @@ static void usage (int argc, char *argv[])
         "                                (default: 1 sample)\n"
         "  -w, --window-size=COUNT       print COUNT samples when a problem is found (minimum: 7)\n"
         "                                Even if COUNT is bigger ripcheck does not use more than 7\n"
-        "                                samples at a time for detecting problems. (default: 7)\n"
+        "                                samples at a time for detecting problems. (default: 7)\n");
+    printf(
+        "      --detectors=LIST          comma separated list of the problems to look for:\n"
+        "                                pop, drop, dupes, clipping, dropout and click\n"
+        "                                (default: pop,drop,dupes)\n"
+        "      --clip-limit=VOLUME       count samples at or beyond VOLUME in either direction as\n"
+        "                                clipped (default: 100 %%)\n"
+        "      --min-clipped=COUNT       set the minimum number of clipped samples in a row that is\n"
+        "                                recognized as clipping to COUNT (default: 3)\n"
+        "                                Clipping is also looked for in the intro and outro.\n"
+        "      --silence-limit=VOLUME    count samples at or below VOLUME in either direction as\n"
+        "                                silent for dropouts (default: 0, i.e. digital zero)\n"
+        "      --min-dropout=TIME        set the minimum length of a stretch in which all channels\n"
+        "                                are silent that is recognized as a dropout to TIME\n"
+        "                                (default: 1 ms)\n"
+        "      --merge-channels[=TIME]   report a problem found in several channels once, listing\n"
+        "                                the other channels, if it starts and is found within TIME\n"
+        "                                in all of them (default: 1 ms). It counts as one bad area\n"
+        "                                and gets one image.\n"
+        "      --adaptive-limits[=VOLUME]\n"
+        "                                make the pop, drop and dupe limits that are given in %%\n"
+        "                                relative to the loudness of each channel instead of full\n"
+        "                                scale. The loudness is the amplitude of a sine with the\n"
+        "                                running RMS of the last 0.5 sec and never counts as lower\n"
+        "                                than VOLUME (default: 1 %%).\n"
+        "      --click-ratio=RATIO       report a sample as a click if its second difference is more\n"
+        "                                than RATIO times the running mean of the second difference\n"
+        "                                of its channel and it sticks out of the cubic interpolation\n"
+        "                                of its neighbours as well (default: 16). Only lone spikes\n"
+        "                                count, not the edges of clipping, silence or pops.\n"
+        "      --click-limit=VOLUME      ignore clicks that deviate less than VOLUME from their\n"
+        "                                neighbours (default: 0.5 %%)\n"
+        "      --compare                 compare the audio data of all files with that of the first\n"
+        "                                one instead of analyzing them, e.g. rips of the same disc\n"
+        "                                from different drives. Each file is aligned to the first\n"
+        "                                one via cross-correlation and the ranges in which they\n"
+        "                                differ are printed as 'difference' lines.\n"
+        "      --max-offset=TIME         look for the same audio up to TIME earlier or later when\n"
+        "                                comparing (default: 2 sec)\n");
+    printf(
+        "      --direct-io               read audio data bypassing the page cache (O_DIRECT)\n"
+        "                                Falls back to dropping read data from the cache if the\n"
+        "                                file system does not support it.\n"
+        "      --checksums               print CRC32, MD5 and AccurateRip checksums of the audio data\n"
+        "                                They are computed while the file is analyzed and always\n"
+        "                                cover all of the audio data, even with --max-time.\n"
+        "                                AccurateRip checksums are printed for 16 bit stereo only\n"
+        "                                and as for a track in the middle of a disc.\n"
+        "      --duplicates              find files with identical audio data and check them only once\n"
+        "                                A file whose audio data matches a file checked before gets the\n"
+        "                                result of that file and a warning naming it. Implies --checksums.\n"
+        "                                Peaks, --stats and --spectrum are only reported for the first.\n"
+        "      --peaks[=DIR]             write a min/max/RMS waveform overview of each file to\n"
+        "                                FILE.peaks, next to the file or below DIR at the path the\n"
+        "                                file was given with. Absolute paths and paths with .. are\n"
+        "                                resolved and mirrored below DIR. It is built while\n"
+        "                                the file is analyzed and has buckets of 256, 4096 and\n"
+        "                                65536 samples. Can't be combined with --start or\n"
+        "                                --time-budget.\n"
+        "      --stats                   print peak, RMS, DC offset, share of zero samples, runs of\n"
+        "                                repeated samples and the bits that are used of each channel\n"
+        "                                They are gathered while the file is analyzed and always\n"
+        "                                cover all of the audio data. Can't be combined with --start\n"
+        "                                or --time-budget.\n"
+        "      --spectrum                print the bandwidth of each channel, where its average\n"
+        "                                spectrum falls to the noise floor at the top of the band\n"
+        "                                A band that ends far below half the sample rate hints at\n"
+        "                                an upsampled file. Short overlapping windows of every few\n"
+        "                                seconds are transformed while the file is analyzed.\n"
+        "                                Can't be combined with --start or --time-budget.\n");
+    printf(
+        "      --cue=FILE                check a disc image described by the CUE sheet FILE\n"
+        "                                Intro and outro are applied to every track and problems\n"
+        "                                are reported with their track. Checks the image named\n"
+        "                                in FILE unless a WAVE file is given.\n"
+        "  -r, --recursive=DIRECTORY     check all files in DIRECTORY and its sub-directories\n"
+        "                                Can be given multiple times. The directories are walked in\n"
+        "                                parallel and the biggest files found are checked first.\n"
+        "      --extensions=LIST         comma separated list of file name extensions of the files\n"
+        "                                checked in directories (default: %s)\n"
+        "      --files-from=FILE         check the files listed in FILE, one per line\n"
+        "                                If FILE is - the list is read from standard input.\n"
+        "                                Checking starts while the list is still being read.\n"
+        "  -0, --null                    file names in --files-from are terminated by NUL\n"
+        "                                characters instead of new lines\n"
+        "      --cache[=DIR]             remember the results of checked files in DIR and skip\n"
+        "                                files that didn't change since (default: ~/.cache/ripcheck)\n"
+        "                                Files are identified by device, inode, size and modification\n"
+        "                                time. Changing any of the analysis options starts over.\n"
+        "      --cache-hash              also identify cached files by a hash of their content\n",
+        RIPCHECK_DEFAULT_EXTENSIONS);
+#ifdef WITH_THREADS
+    printf(
+        "  -j, --jobs=COUNT              check up to COUNT files at once (default: 1)\n"
+        "                                The output of each file is still printed in one piece.\n");
+#endif
+#ifdef WITH_IO_URING
+    printf(
+        "      --io-depth=COUNT          read up to COUNT files ahead using io_uring (default: %"PRIzu")\n"
+        "                                Set to 0 to read files one after another.\n",
+        RIPCHECK_DEFAULT_IO_DEPTH);
+#endif
+    printf(
         "\n"
         "Units:\n"
         "\n"
@@ -158,20 +335,533 @@ static void usage (int argc, char *argv[])
         "Report bugs to: https://github.com/panzi/ripcheck/issues\n");
 }
 
+// what all files of a scan share
+struct scan_config {
+    const struct ripcheck_options *options;
+    struct ripcheck_callbacks     *callbacks;
+    struct ripcheck_cache         *cache;
+    struct ripcheck_duplicates    *dups;
+    // write the waveform pyramids of the files into peaks_dir
+    // (NULL: next to the files)
+    int write_peaks;
+    const char *peaks_dir;
+};
+
+// recorded result of a file
+struct file_result {
+    struct ripcheck_record       *record;
+    // result of a file with identical audio data, owned by the duplicates index
+    const struct ripcheck_record *reused;
+    const char *original;
+    struct ripcheck_fingerprint fingerprint;
+    int status;
+};
+
+// store the result of a file in the cache, failing to do so is not fatal
+static void cache_result(
+    struct ripcheck_cache *cache,
+    const struct ripcheck_cache_key *key,
+    const char *filename,
+    const struct ripcheck_record *record,
+    int status)
+{
+    int errnum = ripcheck_cache_store(cache, key, record, status);
+
+    if (errnum != 0) {
+        fprintf(stderr, "%s: cannot cache result: %s\n", filename, strerror(errnum));
+    }
+}
+
+// check a file recording its events, or reuse the result of a duplicate
+static void record_file(
+    FILE *f,
+    const char *filename,
+    const struct ripcheck_cache_key *key,
+    const struct scan_config *config,
+    struct file_result *result)
+{
+    memset(result, 0, sizeof(*result));
+
+    if (config->dups && ripcheck_duplicates_lookup(config->dups, f, &result->fingerprint,
+            &result->reused, &result->original, &result->status) == 0) {
+        if (key) {
+            cache_result(config->cache, key, filename, result->reused, result->status);
+        }
+        return;
+    }
+
+    struct ripcheck_callbacks callbacks = ripcheck_callbacks_record;
+    result->status = ENOMEM;
+
+    if ((result->record = ripcheck_record_create())) {
+        callbacks.data = result->record;
+        result->status = ripcheck(f, filename, config->options, &callbacks);
+
+        if (key) {
+            cache_result(config->cache, key, filename, result->record, result->status);
+        }
+    }
+}
+
+// write the waveform pyramid of a file, failing to do so is not fatal
+// whether path has a .. component
+static int has_parent_ref(const char *path)
+{
+    for (const char *ptr = path; (ptr = strstr(ptr, "..")); ptr += 2) {
+        if ((ptr == path || ptr[-1] == '/') && (ptr[2] == '/' || ptr[2] == '\0')) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void save_peaks(
+    const char *filename,
+    const struct ripcheck_record *record,
+    const struct scan_config *config)
+{
+    const struct ripcheck_peaks *peaks = ripcheck_record_peaks(record);
+
+    if (!config->write_peaks || !peaks) {
+        return;
+    }
+
+    const char *name = filename;
+    char *real = NULL;
+    size_t dirlen = 0;
+
+    if (config->peaks_dir) {
+        // the path of the file is mirrored below peaks_dir, so files of the
+        // same name in different directories don't overwrite each other
+        if (filename[0] == '/' || has_parent_ref(filename)) {
+            real = realpath(filename, NULL);
+            if (!real) {
+                fprintf(stderr, "%s: cannot write peaks: %s\n", filename, strerror(errno));
+                return;
+            }
+            name = real;
+        }
+
+        while (name[0] == '/') {
+            ++ name;
+        }
+
+        while (name[0] == '.' && name[1] == '/') {
+            name += 2;
+            while (name[0] == '/') {
+                ++ name;
+            }
+        }
+
+        dirlen = strlen(config->peaks_dir);
+    }
+
+    char *path = malloc(dirlen + 1 + strlen(name) + sizeof(".peaks"));
+    if (!path) {
+        fprintf(stderr, "%s: cannot write peaks: %s\n", filename, strerror(errno));
+        free(real);
+        return;
+    }
+
+    int errnum = 0;
+
+    if (config->peaks_dir) {
+        sprintf(path, "%s/%s", config->peaks_dir, name);
+
+        char *slash = strrchr(path + dirlen, '/');
+        if (slash && slash > path + dirlen) {
+            *slash = '\0';
+            errnum = ripcheck_make_dirs(path);
+            *slash = '/';
+        }
+
+        strcat(path, ".peaks");
+    }
+    else {
+        sprintf(path, "%s.peaks", name);
+    }
+    free(real);
+
+    if (errnum != 0) {
+        fprintf(stderr, "%s: cannot write peaks: %s\n", path, strerror(errnum));
+        free(path);
+        return;
+    }
+
+    FILE *f = fopen(path, "wb");
+    errnum = f ? ripcheck_peaks_write(peaks, f) : errno;
+
+    if (f && fclose(f) != 0 && errnum == 0) {
+        errnum = errno;
+    }
+
+    if (errnum != 0) {
+        fprintf(stderr, "%s: cannot write peaks: %s\n", path, strerror(errnum));
+    }
+
+    free(path);
+}
+
+static void print_result(
+    const char *filename,
+    const struct file_result *result,
+    const struct scan_config *config)
+{
+    struct ripcheck_callbacks *callbacks = config->callbacks;
+
+    if (result->reused) {
+        struct ripcheck_context context;
+        memset(&context, 0, sizeof(context));
+        context.filename = filename;
+
+        ripcheck_record_replay_as(result->reused, filename, callbacks);
+        callbacks->warning(callbacks->data, &context,
+            "Audio data is identical to %s, its result was reused.", result->original);
+        save_peaks(filename, result->reused, config);
+    }
+    else if (result->record) {
+        ripcheck_record_replay(result->record, callbacks);
+        save_peaks(filename, result->record, config);
+    }
+    else {
+        fprintf(stderr, "%s: %s\n", filename, strerror(result->status));
+    }
+}
+
+// remember the result for finding duplicates and free it
+static void finish_result(
+    const char *filename,
+    struct file_result *result,
+    const struct scan_config *config)
+{
+    if (config->dups && result->record) {
+        ripcheck_duplicates_add(config->dups, &result->fingerprint, filename, result->record, result->status);
+    }
+    else {
+        ripcheck_record_free(result->record);
+    }
+    result->record = NULL;
+}
+
+// check a file, if there is a cache key the result is stored in the cache
+static int check_file(
+    FILE *f,
+    const char *filename,
+    const struct ripcheck_cache_key *key,
+    const struct scan_config *config)
+{
+    if (!key && !config->dups && !config->write_peaks) {
+        return ripcheck(f, filename, config->options, config->callbacks);
+    }
+
+    struct file_result result;
+    record_file(f, filename, key, config, &result);
+    print_result(filename, &result, config);
+    finish_result(filename, &result, config);
+
+    return result.status;
+}
+
+// check the files one after another, reading ahead using the batch reader
+static int scan_files(
+    struct file_list *list,
+    size_t io_depth,
+    const struct scan_config *config)
+{
+    struct ripcheck_cache *cache = config->cache;
+    struct batch_reader *reader = batch_reader_open(io_depth);
+
+    if (!reader) {
+        perror("ripcheck");
+        return 1;
+    }
+
+    // next file to submit, possibly already found in the cache
+    char  *filename = NULL;
+    struct ripcheck_cache_key *key = NULL;
+    struct ripcheck_record *cached = NULL;
+    int    cached_status = 0;
+
+    size_t queued   = 0;
+    int    listed   = 0;
+    int    status   = 0;
+    while (status == 0) {
+        struct batch_file file;
+
+        // only wait for the directory walk when there is nothing else to do
+        while (!listed) {
+            if (!filename) {
+                int errnum = file_list_next(list, &filename, queued == 0);
+
+                if (errnum == EAGAIN) {
+                    break;
+                }
+                else if (errnum != 0) {
+                    if (errnum != ENOENT) {
+                        errno = errnum;
+                        perror("ripcheck");
+                        status = 1;
+                    }
+                    listed = 1;
+                    break;
+                }
+
+                if (cache) {
+                    ripcheck_cache_lookup(cache, filename, &key, &cached, &cached_status);
+                }
+            }
+
+            if (cached) {
+                // keep the output in order
+                if (queued > 0) {
+                    break;
+                }
+
+                ripcheck_record_replay(cached, config->callbacks);
+                save_peaks(filename, cached, config);
+                ripcheck_record_free(cached);
+                free(filename);
+                cached   = NULL;
+                filename = NULL;
+
+                if (cached_status != 0) {
+                    status = 1;
+                    break;
+                }
+                continue;
+            }
+
+            if (batch_reader_submit(reader, filename, key) != 0) {
+                break;
+            }
+
+            free(filename);
+            filename = NULL;
+            key      = NULL;
+            ++ queued;
+        }
+
+        if (status != 0 || batch_reader_next(reader, &file) != 0) {
+            break;
+        }
+        -- queued;
+
+        if (file.file) {
+            int errnum = check_file(file.file, file.filename, file.data, config);
+
+            if (errnum != 0) {
+                status = 1;
+            }
+        }
+        else {
+            errno = file.errnum;
+            perror(file.filename);
+        }
+
+        ripcheck_cache_key_free(file.data);
+        batch_reader_release(reader, &file);
+    }
+
+    ripcheck_record_free(cached);
+    ripcheck_cache_key_free(key);
+    free(filename);
+
+    // free the cache keys of files that are not checked anymore
+    struct batch_file file;
+    while (batch_reader_next(reader, &file) == 0) {
+        ripcheck_cache_key_free(file.data);
+        batch_reader_release(reader, &file);
+    }
+
+    batch_reader_close(reader);
+
+    return status;
+}
+
+#ifdef WITH_THREADS
+struct scan_job {
+    struct file_list         *list;
+    const struct scan_config *config;
+    pthread_mutex_t           mutex;
+    int                       status;
+};
+
+// check files in parallel, each file's output is recorded and printed at once
+static void *scan_worker(void *ptr)
+{
+    struct scan_job *job = (struct scan_job *)ptr;
+    const struct scan_config *config = job->config;
+    char *filename = NULL;
+
+    while (file_list_next(job->list, &filename, 1) == 0) {
+        pthread_mutex_lock(&job->mutex);
+        int stop = job->status != 0;
+        pthread_mutex_unlock(&job->mutex);
+
+        if (stop) {
+            free(filename);
+            break;
+        }
+
+        struct ripcheck_cache_key *key = NULL;
+        struct file_result result;
+        memset(&result, 0, sizeof(result));
+
+        if (!config->cache || ripcheck_cache_lookup(config->cache, filename, &key,
+                &result.record, &result.status) != 0) {
+            FILE *f = fopen(filename, "rb");
+
+            if (!f) {
+                int errnum = errno;
+                pthread_mutex_lock(&job->mutex);
+                fprintf(stderr, "%s: %s\n", filename, strerror(errnum));
+                pthread_mutex_unlock(&job->mutex);
+                ripcheck_cache_key_free(key);
+                free(filename);
+                continue;
+            }
+
+            record_file(f, filename, key, config, &result);
+            fclose(f);
+        }
+
+        pthread_mutex_lock(&job->mutex);
+        print_result(filename, &result, config);
+
+        if (result.status != 0) {
+            job->status = 1;
+        }
+        pthread_mutex_unlock(&job->mutex);
+
+        finish_result(filename, &result, config);
+        ripcheck_cache_key_free(key);
+        free(filename);
+    }
+
+    return NULL;
+}
+
+static int scan_files_parallel(
+    struct file_list *list,
+    size_t jobs,
+    const struct scan_config *config)
+{
+    struct scan_job job = { list, config, PTHREAD_MUTEX_INITIALIZER, 0 };
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+
+    if (!threads) {
+        perror("ripcheck");
+        return 1;
+    }
+
+    size_t count = 0;
+    for (; count < jobs; ++ count) {
+        int errnum = pthread_create(&threads[count], NULL, scan_worker, &job);
+
+        if (errnum != 0) {
+            if (count == 0) {
+                fprintf(stderr, "ripcheck: %s\n", strerror(errnum));
+                free(threads);
+                return 1;
+            }
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++ i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&job.mutex);
+
+    return job.status;
+}
+#endif
+
+// Compare each file with the first one.
+static int compare_files(
+    char *const *filenames,
+    size_t count,
+    const struct ripcheck_options *options,
+    struct ripcheck_callbacks *callbacks)
+{
+    FILE *first = fopen(filenames[0], "rb");
+
+    if (!first) {
+        perror(filenames[0]);
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t index = 1; index < count; ++ index) {
+        FILE *other = fopen(filenames[index], "rb");
+
+        if (!other) {
+            perror(filenames[index]);
+            status = 1;
+            continue;
+        }
+
+        if (fseeko(first, 0, SEEK_SET) != 0) {
+            perror(filenames[0]);
+            status = 1;
+        }
+        else if (ripcheck_compare(first, filenames[0], other, filenames[index], options, callbacks) != 0) {
+            status = 1;
+        }
+
+        fclose(other);
+    }
+
+    fclose(first);
+
+    return status;
+}
+
 int main (int argc, char *argv[])
 {
     // initialize with default values
-    ripcheck_time_t max_time      = { SIZE_MAX, RIPCHECK_SAMP };
-    ripcheck_time_t intro_length  = { 5, RIPCHECK_SEC };
-    ripcheck_time_t outro_length  = { 5, RIPCHECK_SEC };
-    ripcheck_time_t pop_drop_dist = { 8, RIPCHECK_SAMP };
-    ripcheck_time_t dupe_dist     = { 1, RIPCHECK_SAMP };
-    ripcheck_volume_t pop_limit   = { .volume.ratio = 0.33333, .unit = RIPCHECK_RATIO };
-    ripcheck_volume_t drop_limit  = { .volume.ratio = 0.66666, .unit = RIPCHECK_RATIO };
-    ripcheck_volume_t dupe_limit  = { .volume.ratio = 0.00033, .unit = RIPCHECK_RATIO };
-    size_t min_dupes     = 400;
-    size_t max_bad_areas = SIZE_MAX;
-    size_t window_size   = RIPCHECK_MIN_WINDOW_SIZE;
+    struct ripcheck_options options = {
+        .max_time      = { SIZE_MAX, RIPCHECK_SAMP },
+        .start_time    = { 0, RIPCHECK_SAMP },
+        .intro_length  = { 5, RIPCHECK_SEC },
+        .outro_length  = { 5, RIPCHECK_SEC },
+        .pop_drop_dist = { 8, RIPCHECK_SAMP },
+        .dupe_dist     = { 1, RIPCHECK_SAMP },
+        .pop_limit     = { .volume.ratio = 0.33333, .unit = RIPCHECK_RATIO },
+        .drop_limit    = { .volume.ratio = 0.66666, .unit = RIPCHECK_RATIO },
+        .dupe_limit    = { .volume.ratio = 0.00033, .unit = RIPCHECK_RATIO },
+        .clip_limit    = { .volume.ratio = 1.0, .unit = RIPCHECK_RATIO },
+        .silence_limit = { .volume.absolute = 0, .unit = RIPCHECK_ABSOLUTE },
+        .min_dropout   = { 1, RIPCHECK_MSEC },
+        .merge_dist    = { 1, RIPCHECK_MSEC },
+        .loudness_floor = { .volume.ratio = 0.01, .unit = RIPCHECK_RATIO },
+        .click_limit   = { .volume.ratio = 0.005, .unit = RIPCHECK_RATIO },
+        .click_ratio   = 16,
+        .max_offset    = { 2, RIPCHECK_SEC },
+        .min_dupes     = 400,
+        .min_clipped   = 3,
+        .max_bad_areas = SIZE_MAX,
+        .window_size   = RIPCHECK_MIN_WINDOW_SIZE,
+        .direct_io     = 0,
+        .checksums     = 0
+    };
+    size_t io_depth = RIPCHECK_DEFAULT_IO_DEPTH;
+#ifdef WITH_THREADS
+    size_t jobs     = 1;
+#endif
+    const char *files_from = NULL;
+    int delim = '\n';
+    const char *cache_dir = NULL;
+    int use_cache  = 0;
+    int cache_hash = 0;
+    int find_duplicates = 0;
+    const char *cue_filename = NULL;
+    int write_peaks = 0;
+    const char *peaks_dir = NULL;
+    int compare = 0;
     struct ripcheck_callbacks callbacks = ripcheck_callbacks_print_text;
 
 #ifdef WITH_VISUALIZE
@@ -183,12 +873,23 @@ int main (int argc, char *argv[])
         .zero_color     = { 127, 127, 127 },
         .error_color    = { 255,  32,  32 },
         .error_bg_color = { 255, 196,  64 },
-        .filename       = "{basename}_sample_{first_error_sample}_channel_{channel}_{errorname}.png"
+        .filename       = "{basename}_sample_{first_error_sample}_channel_{channel}_{errorname}.{extension}",
+        .sink           = ripcheck_image_sinks[0],
+        .overview_width    = 1200,
+        .overview_height   = 40,
+        .overview_filename = "{basename}_overview.{extension}"
     };
 #endif
 
+    struct file_list *list = file_list_create();
+
+    if (!list) {
+        perror("ripcheck");
+        return 1;
+    }
+
     int opt = 0, longindex = 0;
-    while ((opt = getopt_long(argc, argv, "hvV,t:b:i:o:p:d:u:w:", long_options, &longindex)) != -1)
+    while ((opt = getopt_long(argc, argv, "hvV,t:b:i:o:p:d:u:w:r:j:0", long_options, &longindex)) != -1)
     {
         switch (opt)
         {
@@ -207,10 +908,16 @@ int main (int argc, char *argv[])
                     return 1;
                 }
 
+                image_options.events    = 1;
                 callbacks.data          = &image_options;
+                callbacks.begin         = ripcheck_image_begin;
                 callbacks.possible_pop  = ripcheck_image_possible_pop;
                 callbacks.possible_drop = ripcheck_image_possible_drop;
                 callbacks.dupes         = ripcheck_image_dupes;
+                callbacks.clipping      = ripcheck_image_clipping;
+                callbacks.dropout       = ripcheck_image_dropout;
+                callbacks.click         = ripcheck_image_click;
+                callbacks.complete      = ripcheck_image_complete;
                 break;
 
 #else
@@ -219,80 +926,103 @@ int main (int argc, char *argv[])
 #endif
 
             case 't':
-                if (ripcheck_parse_time(optarg, &max_time) != 0) {
+                if (ripcheck_parse_time(optarg, &options.max_time) != 0) {
                     fprintf(stderr, "Illegal value for --max-time: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'i':
-                if (ripcheck_parse_time(optarg, &intro_length) != 0) {
+                if (ripcheck_parse_time(optarg, &options.intro_length) != 0) {
                     fprintf(stderr, "Illegal value for --intro-length: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'o':
-                if (ripcheck_parse_time(optarg, &outro_length) != 0) {
+                if (ripcheck_parse_time(optarg, &options.outro_length) != 0) {
                     fprintf(stderr, "Illegal value for --outro-length: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'p':
-                if (ripcheck_parse_volume(optarg, &pop_limit) != 0) {
+                if (ripcheck_parse_volume(optarg, &options.pop_limit) != 0) {
                     fprintf(stderr, "Illegal value for --pop-limit: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'd':
-                if (ripcheck_parse_volume(optarg, &drop_limit) != 0) {
+                if (ripcheck_parse_volume(optarg, &options.drop_limit) != 0) {
                     fprintf(stderr, "Illegal value for --drop-limit: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'u':
-                if (ripcheck_parse_volume(optarg, &dupe_limit) != 0) {
+                if (ripcheck_parse_volume(optarg, &options.dupe_limit) != 0) {
                     fprintf(stderr, "Illegal value for --dupe-limit: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'b':
-                if (parse_size(optarg, &max_bad_areas) != 0 || max_bad_areas == 0) {
+                if (parse_size(optarg, &options.max_bad_areas) != 0 || options.max_bad_areas == 0) {
                     fprintf(stderr, "Illegal value for --max-bad-areas: %s\n", optarg);
                     return 1;
                 }
                 break;
 
             case 'w':
-                if (parse_size(optarg, &window_size) != 0 || window_size < RIPCHECK_MIN_WINDOW_SIZE) {
+                if (parse_size(optarg, &options.window_size) != 0 || options.window_size < RIPCHECK_MIN_WINDOW_SIZE) {
                     fprintf(stderr, "Illegal value for --window-size (minimum is %"PRIzu"): %s\n",
                         RIPCHECK_MIN_WINDOW_SIZE, optarg);
                     return 1;
                 }
                 break;
 
+            case 'r':
+                if (file_list_add_directory(list, optarg) != 0) {
+                    perror("ripcheck");
+                    return 1;
+                }
+                break;
+
+            case 'j':
+#ifdef WITH_THREADS
+                if (parse_size(optarg, &jobs) != 0 || jobs == 0 || jobs > 1024) {
+                    fprintf(stderr, "Illegal value for --jobs: %s\n", optarg);
+                    return 1;
+                }
+                break;
+#else
+                fprintf(stderr,"Not compiled with support for threads.\n");
+                return 1;
+#endif
+
+            case '0':
+                delim = '\0';
+                break;
+
             case 0:
                 switch (longindex) {
                     case 10:
-                        if (ripcheck_parse_time(optarg, &pop_drop_dist) != 0) {
+                        if (ripcheck_parse_time(optarg, &options.pop_drop_dist) != 0) {
                             fprintf(stderr, "Illegal value for --pop-drop-dist: %s\n", optarg);
                             return 1;
                         }
                         break;
 
                     case 11:
-                        if (ripcheck_parse_time(optarg, &dupe_dist) != 0) {
+                        if (ripcheck_parse_time(optarg, &options.dupe_dist) != 0) {
                             fprintf(stderr, "Illegal value for --dupe-dist: %s\n", optarg);
                             return 1;
                         }
                         break;
 
                     case 12:
-                        if (parse_size(optarg, &min_dupes) != 0 || min_dupes <= 1) {
+                        if (parse_size(optarg, &options.min_dupes) != 0 || options.min_dupes <= 1) {
                             fprintf(stderr, "Illegal value for --min-dupes: %s\n", optarg);
                             return 1;
                         }
@@ -310,6 +1040,213 @@ int main (int argc, char *argv[])
                         return 1;
 #endif
 
+                    case 15:
+#ifdef WITH_IO_URING
+                        if (parse_size(optarg, &io_depth) != 0 || io_depth > 4096) {
+                            fprintf(stderr, "Illegal value for --io-depth: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+#else
+                        fprintf(stderr,"Not compiled with support for io_uring.\n");
+                        return 1;
+#endif
+
+                    case 16:
+                        options.direct_io = 1;
+                        break;
+
+                    case 18:
+                        if (file_list_set_extensions(list, optarg) != 0) {
+                            perror("ripcheck");
+                            return 1;
+                        }
+                        break;
+
+                    case 20:
+                        files_from = optarg;
+                        break;
+
+                    case 22:
+                        use_cache = 1;
+                        cache_dir = optarg;
+                        break;
+
+                    case 23:
+                        use_cache  = 1;
+                        cache_hash = 1;
+                        break;
+
+                    case 24:
+                        options.checksums = 1;
+                        break;
+
+                    case 25:
+                        find_duplicates   = 1;
+                        options.checksums = 1;
+                        break;
+
+                    case 26:
+                        cue_filename = optarg;
+                        break;
+
+                    case 27:
+                        options.max_bad_areas = 1;
+                        break;
+
+                    case 28:
+                        if (parse_size(optarg, &options.time_budget) != 0 || options.time_budget == 0) {
+                            fprintf(stderr, "Illegal value for --time-budget: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 29:
+                        if (ripcheck_parse_time(optarg, &options.start_time) != 0) {
+                            fprintf(stderr, "Illegal value for --start: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 30:
+                        if (ripcheck_parse_time(optarg, &options.max_time) != 0) {
+                            fprintf(stderr, "Illegal value for --end: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 31:
+                        options.peaks = 1;
+                        write_peaks   = 1;
+                        peaks_dir     = optarg;
+                        break;
+
+                    case 32:
+#ifdef WITH_VISUALIZE
+                        if (optarg && ripcheck_parse_image_options(optarg, &image_options) != 0) {
+                            fprintf(stderr, "Illegal value for --overview: %s\n", optarg);
+                            return 1;
+                        }
+
+                        // the overview is drawn from the waveform pyramid
+                        options.peaks           = 1;
+                        image_options.overview  = 1;
+                        callbacks.data          = &image_options;
+                        callbacks.begin         = ripcheck_image_begin;
+                        callbacks.possible_pop  = ripcheck_image_possible_pop;
+                        callbacks.possible_drop = ripcheck_image_possible_drop;
+                        callbacks.dupes         = ripcheck_image_dupes;
+                        callbacks.clipping      = ripcheck_image_clipping;
+                        callbacks.dropout       = ripcheck_image_dropout;
+                        callbacks.click         = ripcheck_image_click;
+                        callbacks.complete      = ripcheck_image_complete;
+                        break;
+#else
+                        fprintf(stderr,"Not compiled with support for writing images.\n");
+                        return 1;
+#endif
+
+                    case 33:
+#ifdef WITH_VISUALIZE
+                        image_options.sink = ripcheck_image_sink_by_name(optarg);
+                        if (!image_options.sink) {
+                            fprintf(stderr, "Illegal value for --image-format: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+#else
+                        fprintf(stderr,"Not compiled with support for writing images.\n");
+                        return 1;
+#endif
+
+                    case 34:
+                        if (ripcheck_parse_detectors(optarg, &options.detectors) != 0) {
+                            fprintf(stderr, "Illegal value for --detectors: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 35:
+                        if (ripcheck_parse_volume(optarg, &options.clip_limit) != 0) {
+                            fprintf(stderr, "Illegal value for --clip-limit: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 36:
+                        if (parse_size(optarg, &options.min_clipped) != 0 || options.min_clipped == 0) {
+                            fprintf(stderr, "Illegal value for --min-clipped: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 37:
+                        if (ripcheck_parse_volume(optarg, &options.silence_limit) != 0 ||
+                            (options.silence_limit.unit == RIPCHECK_RATIO ?
+                                options.silence_limit.volume.ratio < 0 :
+                                options.silence_limit.volume.absolute < 0)) {
+                            fprintf(stderr, "Illegal value for --silence-limit: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 38:
+                        if (ripcheck_parse_time(optarg, &options.min_dropout) != 0 || options.min_dropout.time == 0) {
+                            fprintf(stderr, "Illegal value for --min-dropout: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 39:
+                        if (optarg && ripcheck_parse_time(optarg, &options.merge_dist) != 0) {
+                            fprintf(stderr, "Illegal value for --merge-channels: %s\n", optarg);
+                            return 1;
+                        }
+                        options.merge_channels = 1;
+                        break;
+
+                    case 40:
+                        if (optarg && ripcheck_parse_volume(optarg, &options.loudness_floor) != 0) {
+                            fprintf(stderr, "Illegal value for --adaptive-limits: %s\n", optarg);
+                            return 1;
+                        }
+                        options.adaptive_limits = 1;
+                        break;
+
+                    case 41:
+                        if (parse_size(optarg, &options.click_ratio) != 0 || options.click_ratio == 0 ||
+                            options.click_ratio > 100000) {
+                            fprintf(stderr, "Illegal value for --click-ratio: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 42:
+                        if (ripcheck_parse_volume(optarg, &options.click_limit) != 0) {
+                            fprintf(stderr, "Illegal value for --click-limit: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 43:
+                        compare = 1;
+                        break;
+
+                    case 44:
+                        if (ripcheck_parse_time(optarg, &options.max_offset) != 0) {
+                            fprintf(stderr, "Illegal value for --max-offset: %s\n", optarg);
+                            return 1;
+                        }
+                        break;
+
+                    case 45:
+                        options.stats = 1;
+                        break;
+
+                    case 46:
+                        options.spectrum = 1;
+                        break;
+
                     default:
                         fprintf(stderr, "See --help for usage information.\n");
                         return 255;
@@ -322,32 +1259,154 @@ int main (int argc, char *argv[])
         }
     }
 
-    if (optind >= argc) {
-        return ripcheck(stdin, "<stdin>", max_time, intro_length, outro_length, pop_drop_dist,
-            dupe_dist, pop_limit, drop_limit, dupe_limit, min_dupes, max_bad_areas, window_size,
-            &callbacks) == 0 ? 0 : 1;
+    if (options.time_budget > 0 && (options.checksums || use_cache)) {
+        fprintf(stderr, "--time-budget can't be combined with --checksums, --duplicates or --cache.\n");
+        return 1;
     }
-    else {
-        for (int i = optind; i < argc; ++ i) {
-            FILE *f = fopen(argv[i], "rb");
 
-            if (f) {
-                int errnum = ripcheck(f, argv[i], max_time, intro_length, outro_length, pop_drop_dist,
-                    dupe_dist, pop_limit, drop_limit, dupe_limit, min_dupes, max_bad_areas, window_size,
-                    &callbacks);
-                fclose(f);
+    if (options.start_time.time > 0 && options.checksums) {
+        fprintf(stderr, "--start can't be combined with --checksums or --duplicates.\n");
+        return 1;
+    }
 
-                if (errnum != 0) {
-                    return 1;
-                }
+    if (options.peaks && (options.start_time.time > 0 || options.time_budget > 0)) {
+        fprintf(stderr, "--peaks and --overview can't be combined with --start or --time-budget.\n");
+        return 1;
+    }
+
+    if ((options.stats || options.spectrum) && (options.start_time.time > 0 || options.time_budget > 0)) {
+        fprintf(stderr, "--stats and --spectrum can't be combined with --start or --time-budget.\n");
+        return 1;
+    }
+
+    if (compare) {
+        if (argc - optind < 2 || files_from || cue_filename) {
+            fprintf(stderr, "--compare needs at least two WAVE files.\n");
+            return 1;
+        }
+
+        if (use_cache || options.checksums || options.time_budget > 0 ||
+            options.start_time.time > 0 || options.peaks || options.stats || options.spectrum) {
+            fprintf(stderr, "--compare can't be combined with --cache, --checksums, --duplicates, "
+                "--time-budget, --start, --peaks, --overview, --stats or --spectrum.\n");
+            return 1;
+        }
+
+        file_list_free(list);
+        return compare_files(argv + optind, argc - optind, &options, &callbacks);
+    }
+
+    struct ripcheck_cue cue = { NULL, NULL, 0 };
+    char *cue_image = NULL;
+    if (cue_filename) {
+        if (argc - optind > 1 || files_from || file_list_has_directories(list)) {
+            fprintf(stderr, "--cue can only be used to check a single WAVE file.\n");
+            return 1;
+        }
+
+        FILE *f = fopen(cue_filename, "r");
+        if (!f) {
+            perror(cue_filename);
+            return 1;
+        }
+
+        int errnum = ripcheck_parse_cue(f, cue_filename, &cue);
+        fclose(f);
+
+        if (errnum != 0) {
+            if (errnum != EINVAL) {
+                fprintf(stderr, "%s: %s\n", cue_filename, strerror(errnum));
             }
-            else {
-                perror(argv[i]);
+            return 1;
+        }
+
+        options.tracks      = cue.tracks;
+        options.track_count = cue.track_count;
+
+        if (optind >= argc) {
+            // the image is named relative to the CUE sheet
+            const char *slash = strrchr(cue_filename, '/');
+            const size_t dirlen = slash && cue.filename[0] != '/' ? (size_t)(slash - cue_filename + 1) : 0;
+
+            cue_image = malloc(dirlen + strlen(cue.filename) + 1);
+            if (!cue_image) {
+                perror("ripcheck");
+                return 1;
             }
+
+            memcpy(cue_image, cue_filename, dirlen);
+            strcpy(cue_image + dirlen, cue.filename);
         }
     }
 
-    return 0;
+    if (cue_image) {
+        file_list_add_files(list, &cue_image, 1);
+    }
+    else {
+        file_list_add_files(list, argv + optind, argc - optind);
+    }
+
+    FILE *manifest = NULL;
+    if (files_from) {
+        manifest = strcmp(files_from, "-") == 0 ? stdin : fopen(files_from, "r");
+
+        if (!manifest) {
+            perror(files_from);
+            file_list_free(list);
+            return 1;
+        }
+
+        file_list_set_manifest(list, manifest, delim);
+    }
+    else if (optind >= argc && !cue_image && !file_list_has_directories(list)) {
+        file_list_free(list);
+        return ripcheck(stdin, "<stdin>", &options, &callbacks) == 0 ? 0 : 1;
+    }
+
+    struct scan_config config = { &options, &callbacks, NULL, NULL, write_peaks, peaks_dir };
+    int errnum = use_cache ? ripcheck_cache_open(&config.cache, cache_dir, cache_hash, &options) : 0;
+    int status = 0;
+
+    if (errnum != 0) {
+        fprintf(stderr, "ripcheck: cannot open cache: %s\n", strerror(errnum));
+        status = 1;
+    }
+    else if (find_duplicates && (errnum = ripcheck_duplicates_create(&config.dups)) != 0) {
+        fprintf(stderr, "ripcheck: %s\n", strerror(errnum));
+        status = 1;
+    }
+    else if ((errnum = file_list_start(list, RIPCHECK_WALK_THREADS)) != 0) {
+        fprintf(stderr, "ripcheck: %s\n", strerror(errnum));
+        status = 1;
+    }
+#ifdef WITH_THREADS
+    else if (jobs > 1) {
+        status = scan_files_parallel(list, jobs, &config);
+    }
+#endif
+    else {
+        // reading files ahead would fill the page cache or, with a time
+        // budget, read data that is never analyzed
+        status = scan_files(list,
+            (argc - optind > 1 || manifest || file_list_has_directories(list)) &&
+                !options.direct_io && !options.time_budget ? io_depth : 0,
+            &config);
+    }
+
+    file_list_free(list);
+    ripcheck_cache_close(config.cache);
+    ripcheck_duplicates_free(config.dups);
+    ripcheck_cue_cleanup(&cue);
+    free(cue_image);
+#ifdef WITH_VISUALIZE
+    ripcheck_image_cleanup(&image_options);
+#endif
+
+    if (manifest && manifest != stdin) {
+        fclose(manifest);
+    }
+
+    return status;
 }
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,377 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ripcheck.h"
+#include "ripcheck_endian.h"
+#include "peaks.h"
+
+#define PEAKS_MAGIC "RCPEAKS1"
+
+static const size_t peaks_bucket_sizes[RIPCHECK_PEAKS_LEVELS] = RIPCHECK_PEAKS_BUCKET_SIZES;
+
+static void peak_sum_reset(struct ripcheck_peak_sum *sum)
+{
+    sum->min     = INT_MAX;
+    sum->max     = INT_MIN;
+    sum->squares = 0;
+    sum->count   = 0;
+}
+
+uint32_t ripcheck_isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit  = (uint64_t)1 << 62;
+
+    while (bit > value) bit >>= 2;
+
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root   = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+void ripcheck_peaks_cleanup(struct ripcheck_peaks *peaks)
+{
+    for (size_t i = 0; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        free(peaks->levels[i].buckets);
+        free(peaks->levels[i].sums);
+        peaks->levels[i].buckets = NULL;
+        peaks->levels[i].sums    = NULL;
+    }
+}
+
+static int peaks_alloc(struct ripcheck_peaks *peaks)
+{
+    for (size_t i = 0; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        struct ripcheck_peaks_level *level = &peaks->levels[i];
+        const size_t capacity = level->capacity > 0 ? level->capacity : 1;
+
+        level->buckets = malloc(capacity * peaks->channels * sizeof(struct ripcheck_peak));
+        level->sums    = malloc(peaks->channels * sizeof(struct ripcheck_peak_sum));
+
+        if (!level->buckets || !level->sums) {
+            int errnum = errno;
+            ripcheck_peaks_cleanup(peaks);
+            return errnum;
+        }
+
+        level->capacity = capacity;
+        for (size_t channel = 0; channel < peaks->channels; ++ channel) {
+            peak_sum_reset(&level->sums[channel]);
+        }
+    }
+
+    return 0;
+}
+
+int ripcheck_peaks_init(struct ripcheck_peaks *peaks, const struct wave_fmt *fmt, uint64_t frames)
+{
+    memset(peaks, 0, sizeof(*peaks));
+
+    peaks->sample_rate     = fmt->sample_rate;
+    peaks->channels        = fmt->channels;
+    peaks->bits_per_sample = fmt->bits_per_sample;
+
+    for (size_t i = 0; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        peaks->levels[i].bucket_size = peaks_bucket_sizes[i];
+        peaks->levels[i].capacity    = (frames + peaks_bucket_sizes[i] - 1) / peaks_bucket_sizes[i];
+    }
+
+    return peaks_alloc(peaks);
+}
+
+// append the current bucket of every channel to the level
+static void peaks_close(struct ripcheck_peaks_level *level, size_t channels)
+{
+    if (level->count == level->capacity) {
+        struct ripcheck_peak *buckets = realloc(level->buckets,
+            level->capacity * 2 * channels * sizeof(struct ripcheck_peak));
+
+        // drop the bucket if there is no memory, it is only an overview
+        if (!buckets) {
+            for (size_t channel = 0; channel < channels; ++ channel) {
+                peak_sum_reset(&level->sums[channel]);
+            }
+            return;
+        }
+
+        level->buckets   = buckets;
+        level->capacity *= 2;
+    }
+
+    struct ripcheck_peak *bucket = &level->buckets[level->count * channels];
+    for (size_t channel = 0; channel < channels; ++ channel) {
+        struct ripcheck_peak_sum *sum = &level->sums[channel];
+
+        bucket[channel].min = sum->min;
+        bucket[channel].max = sum->max;
+        const uint32_t rms = ripcheck_isqrt(sum->squares / sum->count);
+        bucket[channel].rms = rms > UINT16_MAX ? UINT16_MAX : (uint16_t)rms;
+        peak_sum_reset(sum);
+    }
+    ++ level->count;
+}
+
+// the lowest level is complete, add it to the levels above
+static void peaks_close_lowest(struct ripcheck_peaks *peaks)
+{
+    const size_t channels = peaks->channels;
+    const struct ripcheck_peak_sum *lowest = peaks->levels[0].sums;
+
+    for (size_t i = 1; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        struct ripcheck_peak_sum *sums = peaks->levels[i].sums;
+
+        for (size_t channel = 0; channel < channels; ++ channel) {
+            if (lowest[channel].min < sums[channel].min) sums[channel].min = lowest[channel].min;
+            if (lowest[channel].max > sums[channel].max) sums[channel].max = lowest[channel].max;
+            sums[channel].squares += lowest[channel].squares;
+            sums[channel].count   += lowest[channel].count;
+        }
+    }
+
+    peaks_close(&peaks->levels[0], channels);
+
+    for (size_t i = 1; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        if (peaks->levels[i].sums[0].count >= peaks->levels[i].bucket_size) {
+            peaks_close(&peaks->levels[i], channels);
+        }
+    }
+}
+
+void ripcheck_peaks_update(struct ripcheck_peaks *peaks, const int *samples, size_t frames)
+{
+    const size_t channels   = peaks->channels;
+    const unsigned int bits = peaks->bits_per_sample;
+
+    struct ripcheck_peaks_level *lowest = &peaks->levels[0];
+    struct ripcheck_peak_sum *sums = lowest->sums;
+
+    for (size_t frame = 0; frame < frames; ++ frame) {
+        const int *frame_samples = samples + frame * channels;
+
+        for (size_t channel = 0; channel < channels; ++ channel) {
+            int x = frame_samples[channel];
+
+            if (bits != 16) {
+                x = bits > 16 ? x / (1 << (bits - 16)) : x * (1 << (16 - bits));
+            }
+
+            struct ripcheck_peak_sum *sum = &sums[channel];
+            if (x < sum->min) sum->min = x;
+            if (x > sum->max) sum->max = x;
+            sum->squares += (uint64_t)((int64_t)x * x);
+            ++ sum->count;
+        }
+
+        if (sums[0].count == lowest->bucket_size) {
+            peaks_close_lowest(peaks);
+        }
+    }
+
+    peaks->frames += frames;
+}
+
+void ripcheck_peaks_final(struct ripcheck_peaks *peaks)
+{
+    if (peaks->levels[0].sums[0].count > 0) {
+        peaks_close_lowest(peaks);
+    }
+
+    for (size_t i = 1; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        if (peaks->levels[i].sums[0].count > 0) {
+            peaks_close(&peaks->levels[i], peaks->channels);
+        }
+    }
+}
+
+int ripcheck_peaks_copy(struct ripcheck_peaks *dest, const struct ripcheck_peaks *src)
+{
+    *dest = *src;
+
+    for (size_t i = 0; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        dest->levels[i].capacity = src->levels[i].count;
+    }
+
+    int errnum = peaks_alloc(dest);
+    if (errnum != 0) {
+        return errnum;
+    }
+
+    for (size_t i = 0; i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        memcpy(dest->levels[i].buckets, src->levels[i].buckets,
+            src->levels[i].count * src->channels * sizeof(struct ripcheck_peak));
+    }
+
+    return 0;
+}
+
+static int write_bytes(const void *data, size_t size, FILE *f)
+{
+    return fwrite(data, 1, size, f) == size ? 0 : EIO;
+}
+
+static int write_u16(uint16_t value, FILE *f)
+{
+    value = htole16(value);
+    return write_bytes(&value, sizeof(value), f);
+}
+
+static int write_u32(uint32_t value, FILE *f)
+{
+    value = htole32(value);
+    return write_bytes(&value, sizeof(value), f);
+}
+
+static int write_u64(uint64_t value, FILE *f)
+{
+    value = htole64(value);
+    return write_bytes(&value, sizeof(value), f);
+}
+
+int ripcheck_peaks_write(const struct ripcheck_peaks *peaks, FILE *f)
+{
+    int errnum = write_bytes(PEAKS_MAGIC, 8, f);
+
+    if (errnum == 0) errnum = write_u32(peaks->sample_rate, f);
+    if (errnum == 0) errnum = write_u16(peaks->channels, f);
+    if (errnum == 0) errnum = write_u16(RIPCHECK_PEAKS_LEVELS, f);
+    if (errnum == 0) errnum = write_u64(peaks->frames, f);
+
+    for (size_t i = 0; errnum == 0 && i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        errnum = write_u32(peaks->levels[i].bucket_size, f);
+        if (errnum == 0) errnum = write_u64(peaks->levels[i].count, f);
+    }
+
+    for (size_t i = 0; errnum == 0 && i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        const struct ripcheck_peaks_level *level = &peaks->levels[i];
+        const size_t count = level->count * peaks->channels;
+
+        for (size_t j = 0; errnum == 0 && j < count; ++ j) {
+            errnum = write_u16(level->buckets[j].min, f);
+            if (errnum == 0) errnum = write_u16(level->buckets[j].max, f);
+            if (errnum == 0) errnum = write_u16(level->buckets[j].rms, f);
+        }
+    }
+
+    return errnum;
+}
+
+static int read_bytes(void *data, size_t size, FILE *f)
+{
+    if (fread(data, 1, size, f) != size) {
+        return ferror(f) ? EIO : EINVAL;
+    }
+    return 0;
+}
+
+static int read_u16(uint16_t *value, FILE *f)
+{
+    int errnum = read_bytes(value, sizeof(*value), f);
+    *value = le16toh(*value);
+    return errnum;
+}
+
+static int read_u32(uint32_t *value, FILE *f)
+{
+    int errnum = read_bytes(value, sizeof(*value), f);
+    *value = le32toh(*value);
+    return errnum;
+}
+
+static int read_u64(uint64_t *value, FILE *f)
+{
+    int errnum = read_bytes(value, sizeof(*value), f);
+    *value = le64toh(*value);
+    return errnum;
+}
+
+int ripcheck_peaks_read(struct ripcheck_peaks *peaks, FILE *f)
+{
+    char magic[8];
+    uint16_t levels = 0;
+    int errnum = read_bytes(magic, sizeof(magic), f);
+
+    memset(peaks, 0, sizeof(*peaks));
+
+    if (errnum == 0) errnum = memcmp(magic, PEAKS_MAGIC, 8) == 0 ? 0 : EINVAL;
+    if (errnum == 0) errnum = read_u32(&peaks->sample_rate, f);
+    if (errnum == 0) errnum = read_u16(&peaks->channels, f);
+    if (errnum == 0) errnum = read_u16(&levels, f);
+    if (errnum == 0) errnum = read_u64(&peaks->frames, f);
+
+    if (errnum == 0 && (levels != RIPCHECK_PEAKS_LEVELS || peaks->channels == 0)) {
+        errnum = EINVAL;
+    }
+
+    for (size_t i = 0; errnum == 0 && i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        uint32_t bucket_size = 0;
+        uint64_t count = 0;
+
+        errnum = read_u32(&bucket_size, f);
+        if (errnum == 0) errnum = read_u64(&count, f);
+
+        if (errnum == 0 && (bucket_size != peaks_bucket_sizes[i] ||
+                count != (peaks->frames + bucket_size - 1) / bucket_size)) {
+            errnum = EINVAL;
+        }
+
+        peaks->levels[i].bucket_size = bucket_size;
+        peaks->levels[i].capacity    = count;
+    }
+
+    if (errnum != 0 || (errnum = peaks_alloc(peaks)) != 0) {
+        return errnum;
+    }
+
+    for (size_t i = 0; errnum == 0 && i < RIPCHECK_PEAKS_LEVELS; ++ i) {
+        struct ripcheck_peaks_level *level = &peaks->levels[i];
+        const size_t count = level->capacity * peaks->channels;
+
+        for (size_t j = 0; errnum == 0 && j < count; ++ j) {
+            uint16_t min = 0, max = 0;
+            errnum = read_u16(&min, f);
+            if (errnum == 0) errnum = read_u16(&max, f);
+            if (errnum == 0) errnum = read_u16(&level->buckets[j].rms, f);
+            level->buckets[j].min = (int16_t)min;
+            level->buckets[j].max = (int16_t)max;
+        }
+        level->count = level->capacity;
+    }
+
+    if (errnum != 0) {
+        ripcheck_peaks_cleanup(peaks);
+    }
+
+    return errnum;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
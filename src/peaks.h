@@ -0,0 +1,91 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_PEAKS_H__
+#define RIPCHECK_PEAKS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// number of levels of the waveform pyramid and frames per bucket of each level
+#define RIPCHECK_PEAKS_LEVELS 3
+#define RIPCHECK_PEAKS_BUCKET_SIZES { 256, 4096, 65536 }
+
+struct wave_fmt;
+
+// Minimum, maximum and RMS of the samples of one channel in a bucket, scaled
+// to 16 bit no matter the bits per sample of the file.
+struct ripcheck_peak {
+    int16_t  min;
+    int16_t  max;
+    uint16_t rms;
+};
+
+struct ripcheck_peak_sum {
+    int      min;
+    int      max;
+    uint64_t squares;
+    size_t   count;
+};
+
+struct ripcheck_peaks_level {
+    size_t bucket_size;
+    // buckets of all channels interleaved like the samples
+    struct ripcheck_peak *buckets;
+    size_t count;
+    size_t capacity;
+    // the bucket that is currently filled, one per channel
+    struct ripcheck_peak_sum *sums;
+};
+
+// Min/max/RMS pyramid of a data chunk that is built while it is read.
+struct ripcheck_peaks {
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t bits_per_sample;
+    uint64_t frames;
+    struct ripcheck_peaks_level levels[RIPCHECK_PEAKS_LEVELS];
+};
+
+// integer square root, rounded down
+uint32_t ripcheck_isqrt(uint64_t value);
+
+// frames is the expected number of frames, used to allocate the buckets
+int ripcheck_peaks_init(struct ripcheck_peaks *peaks, const struct wave_fmt *fmt, uint64_t frames);
+
+// Feed frames frames of samples as decoded by ripcheck_decode().
+void ripcheck_peaks_update(struct ripcheck_peaks *peaks, const int *samples, size_t frames);
+
+// add the partially filled buckets at the end of the data
+void ripcheck_peaks_final(struct ripcheck_peaks *peaks);
+
+int ripcheck_peaks_copy(struct ripcheck_peaks *dest, const struct ripcheck_peaks *src);
+
+// Sidecar format, all numbers little endian:
+//   "RCPEAKS1", sample rate (u32), channels (u16), levels (u16), frames (u64)
+//   per level: frames per bucket (u32), bucket count (u64)
+//   per level: bucket count * channels * (min (i16), max (i16), rms (u16))
+int ripcheck_peaks_write(const struct ripcheck_peaks *peaks, FILE *f);
+int ripcheck_peaks_read(struct ripcheck_peaks *peaks, FILE *f);
+
+void ripcheck_peaks_cleanup(struct ripcheck_peaks *peaks);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
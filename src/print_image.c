@@ -18,6 +18,8 @@
 
 #include "print_text.h"
 #include "print_image.h"
+#include "peaks.h"
+#include "image_sink.h"
 
 #include <limits.h>
 #include <errno.h>
@@ -25,110 +27,11 @@
 #include <strings.h>
 #include <ctype.h>
 #include <stdarg.h>
-#include <png.h>
 
 #ifndef HAVE_STRLCPY
 size_t strlcpy(char * dst, const char * src, size_t size);
 #endif
 
-static png_bytep *alloc_image(size_t width, size_t height)
-{
-    png_bytep *img = calloc(sizeof(png_bytep), height);
-
-    if (!img) return NULL;
-
-    size_t row_size = 3 * sizeof(png_byte) * width;
-    for (size_t y = 0; y < height; ++ y) {
-        png_bytep row = img[y] = malloc(row_size);
-
-        if (!row) {
-            for (size_t i = 0; i < y; ++ i) {
-                free(img[i]);
-            }
-            free(img);
-            return NULL;
-        }
-    }
-
-    return img;
-}
-
-static void free_image(png_bytep *img, size_t height)
-{
-    for (size_t y = 0; y < height; ++ y) {
-        free(img[y]);
-    }
-    free(img);
-}
-
-static void fill_rect(png_bytep *img,
-    size_t x1, size_t y1, size_t x2, size_t y2,
-    uint8_t color[3])
-{
-    uint8_t r = color[0];
-    uint8_t g = color[1];
-    uint8_t b = color[2];
-    for (size_t y = y1; y <= y2; ++ y) {
-        for (size_t x = x1; x <= x2; ++ x) {
-            size_t i = 3 * x;
-            png_bytep row = img[y];
-            row[i + 0] = r;
-            row[i + 1] = g;
-            row[i + 2] = b;
-        }
-    }
-}
-
-static void write_image(const char *filename, png_bytep *img, size_t width, size_t height)
-{
-    FILE *fp = NULL;
-    png_structp png = NULL;
-    png_infop info  = NULL;
-
-    fp = fopen(filename, "wb");
-
-    if (!fp) {
-        perror(filename);
-        goto finalize;
-    }
-
-    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-
-    if (!png) {
-        perror(filename);
-        goto finalize;
-    }
-
-    info = png_create_info_struct(png);
-
-    if (!info) {
-        perror(filename);
-        goto finalize;
-    }
-
-    if (setjmp(png_jmpbuf(png))) {
-        perror(filename);
-        goto finalize;
-    }
-
-    png_init_io(png, fp);
-
-    // write header (8 bit color depth)
-    png_set_IHDR(png, info, width, height,
-        8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-    png_write_info(png, info);
-    png_write_image(png, img);
-    png_write_end(png, NULL);
-
-    printf("written image: %s\n", filename);
-
-finalize:
-    if (fp)  fclose(fp);
-    if (png) png_destroy_write_struct(&png, info ? &info : NULL);
-}
-
 static const char *basename(const char *path)
 {
     const char *ptr = strrchr(path, '/');
@@ -455,6 +358,29 @@ static size_t format_window_size(
     return n < 0 ? 0 : n;
 }
 
+static size_t format_extension(
+    char  *str,
+    size_t size,
+    const struct ripcheck_image_options *image_options,
+    const struct ripcheck_context       *context,
+    size_t       window_offset,
+    const char  *what,
+    uint16_t     channel,
+    size_t last_window_sample,
+    size_t first_error_sample,
+    size_t last_error_sample)
+{
+    (void)context;
+    (void)window_offset;
+    (void)what;
+    (void)channel;
+    (void)last_window_sample;
+    (void)first_error_sample;
+    (void)last_error_sample;
+
+    return strlcpy(str, image_options->sink->extension, size);
+}
+
 struct filename_format_var {
     const char          *name;
     filename_formatter_t formatter;
@@ -473,6 +399,7 @@ static struct filename_format_var filename_format_vars[] = {
     {"first_window_sample", format_first_window_sample},
     {"last_window_sample",  format_last_window_sample},
     {"window_size",         format_window_size},
+    {"extension",           format_extension},
     {0, 0}
 };
 
@@ -718,14 +645,16 @@ static void print_image(
         return;
     }
 
-    png_bytep *img = alloc_image(width, height);
+    struct ripcheck_canvas canvas;
+    int errnum = ripcheck_canvas_init(&canvas, image_options->sink, width, height);
 
-    if (!img) {
-        perror(filename);
+    if (errnum != 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errnum));
+        ripcheck_canvas_cleanup(&canvas);
         return;
     }
 
-    fill_rect(img, 0, 0, width - 1, height - 1, image_options->bg_color);
+    ripcheck_canvas_fill_rect(&canvas, 0, 0, width - 1, height - 1, image_options->bg_color);
 
     const size_t offset = (window_offset + channel + channels +
         (context->window_size - samples) * channels) % window_ints;
@@ -738,7 +667,7 @@ static void print_image(
         uint8_t *color;
         if (sample >= first_error_sample && sample <= last_error_sample) {
             color = image_options->error_color;
-            fill_rect(img, x, 0, x + sample_width - 1, height - 1, image_options->error_bg_color);
+            ripcheck_canvas_fill_rect(&canvas, x, 0, x + sample_width - 1, height - 1, image_options->error_bg_color);
         }
         else {
             color = image_options->wave_color;
@@ -746,25 +675,24 @@ static void print_image(
 
         if (val < 0) {
             val = -val;
-            fill_rect(img,
+            ripcheck_canvas_fill_rect(&canvas,
                 x, zero,
                 x + sample_width - 1,
                 (unsigned int)val >= sample_height ? height - 1 : zero + val,
                 color);
         }
         else {
-            fill_rect(img,
+            ripcheck_canvas_fill_rect(&canvas,
                 x, (unsigned int)val > zero ? 0 : zero - val,
                 x + sample_width - 1, zero,
                 color);
         }
     }
 
-    fill_rect(img, 0, zero, width - 1, zero, image_options->zero_color);
-
-    write_image(filename, img, width, height);
+    ripcheck_canvas_fill_rect(&canvas, 0, zero, width - 1, zero, image_options->zero_color);
 
-    free_image(img, height);
+    ripcheck_canvas_write(&canvas, filename);
+    ripcheck_canvas_cleanup(&canvas);
 }
 
 static int parse_color_channel(const char *str, uint8_t *compptr) {
@@ -905,6 +833,14 @@ int ripcheck_parse_image_options(const char *str, struct ripcheck_image_options
             if ((errnum = parse_dim(value, &endptr, &image_options->sample_height)) != 0)
                 return errnum;
         }
+        else if (strncasecmp(str, "overview-width", keylen) == 0) {
+            if ((errnum = parse_dim(value, &endptr, &image_options->overview_width)) != 0)
+                return errnum;
+        }
+        else if (strncasecmp(str, "overview-height", keylen) == 0) {
+            if ((errnum = parse_dim(value, &endptr, &image_options->overview_height)) != 0)
+                return errnum;
+        }
         else if (strncasecmp(str, "bg-color", keylen) == 0) {
             if ((errnum = parse_color(value, &endptr, image_options->bg_color)) != 0)
                 return errnum;
@@ -939,6 +875,183 @@ int ripcheck_parse_image_options(const char *str, struct ripcheck_image_options
     return 0;
 }
 
+static void add_marker(
+    struct ripcheck_image_options *image_options,
+    uint16_t channel,
+    size_t   first_sample,
+    size_t   last_sample)
+{
+    if (image_options->marker_count == image_options->marker_capacity) {
+        size_t capacity = image_options->marker_capacity ? image_options->marker_capacity * 2 : 16;
+        struct ripcheck_image_marker *markers = realloc(image_options->markers,
+            capacity * sizeof(struct ripcheck_image_marker));
+
+        if (!markers) {
+            perror("overview");
+            return;
+        }
+
+        image_options->markers         = markers;
+        image_options->marker_capacity = capacity;
+    }
+
+    struct ripcheck_image_marker *marker = &image_options->markers[image_options->marker_count ++];
+    marker->first_sample = first_sample;
+    marker->last_sample  = last_sample;
+    marker->channel      = channel;
+}
+
+// Mark the problem in channel and in all other channels it was found in.
+static void add_markers(
+    struct ripcheck_image_options *image_options,
+    const struct ripcheck_context *context,
+    uint16_t channel,
+    size_t   first_sample,
+    size_t   last_sample)
+{
+    add_marker(image_options, channel, first_sample, last_sample);
+
+    for (uint16_t index = 0; index < context->fmt.channels && index < 64; ++ index) {
+        if (index != channel && (context->channel_mask & ((uint64_t)1 << index))) {
+            add_marker(image_options, index, first_sample, last_sample);
+        }
+    }
+}
+
+// Draw the whole file from the coarsest level of the pyramid that still has a
+// bucket for every column. Each channel gets its own lane and the columns
+// that contain a problem get the error colors.
+static void print_overview(
+    struct ripcheck_image_options *image_options,
+    const struct ripcheck_context *context,
+    const struct ripcheck_peaks   *peaks)
+{
+    char filename[PATH_MAX];
+
+    size_t namelen = format_image_filename(filename, PATH_MAX, image_options->overview_filename,
+        image_options, context, 0, "overview", 0, peaks->frames ? peaks->frames - 1 : 0,
+        0, peaks->frames ? peaks->frames - 1 : 0);
+
+    if (namelen >= PATH_MAX) {
+        fprintf(stderr, "error: image file name too long\n");
+        return;
+    }
+
+    const struct ripcheck_peaks_level *level = &peaks->levels[0];
+    for (size_t i = RIPCHECK_PEAKS_LEVELS; i > 0; -- i) {
+        if (peaks->levels[i - 1].count >= image_options->overview_width) {
+            level = &peaks->levels[i - 1];
+            break;
+        }
+    }
+
+    if (level->count == 0 || peaks->channels == 0) {
+        return;
+    }
+
+    const size_t channels    = peaks->channels;
+    const size_t lane_height = image_options->overview_height;
+    const size_t lane        = lane_height * 2 + 1;
+    const size_t height      = lane * channels;
+    const size_t width       = level->count < image_options->overview_width ?
+        level->count : image_options->overview_width;
+
+    uint8_t *marked = calloc(width * channels, 1);
+
+    if (!marked) {
+        perror(filename);
+        return;
+    }
+
+    for (size_t i = 0; i < image_options->marker_count; ++ i) {
+        const struct ripcheck_image_marker *marker = &image_options->markers[i];
+
+        if (marker->channel >= channels || marker->first_sample >= peaks->frames) {
+            continue;
+        }
+
+        const size_t last = marker->last_sample < peaks->frames ? marker->last_sample : peaks->frames - 1;
+        const size_t x1 = (uint64_t)marker->first_sample * width / peaks->frames;
+        const size_t x2 = (uint64_t)last * width / peaks->frames;
+        for (size_t x = x1; x <= x2; ++ x) {
+            marked[x * channels + marker->channel] = 1;
+        }
+    }
+
+    struct ripcheck_canvas canvas;
+    int errnum = ripcheck_canvas_init(&canvas, image_options->sink, width, height);
+
+    if (errnum != 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errnum));
+        ripcheck_canvas_cleanup(&canvas);
+        free(marked);
+        return;
+    }
+
+    ripcheck_canvas_fill_rect(&canvas, 0, 0, width - 1, height - 1, image_options->bg_color);
+
+    // one lane after the other, so that vector images can merge the
+    // rectangles of a lane that have the same color
+    for (size_t channel = 0; channel < channels; ++ channel) {
+        const size_t top  = channel * lane;
+        const size_t zero = top + lane_height;
+
+        for (size_t x = 0; x < width; ++ x) {
+            if (marked[x * channels + channel]) {
+                ripcheck_canvas_fill_rect(&canvas, x, top, x, top + lane - 1, image_options->error_bg_color);
+            }
+        }
+
+        for (size_t x = 0; x < width; ++ x) {
+            const size_t first_bucket = (uint64_t)x * level->count / width;
+            const size_t end_bucket   = (uint64_t)(x + 1) * level->count / width;
+            int min = INT16_MAX;
+            int max = INT16_MIN;
+
+            for (size_t bucket = first_bucket; bucket < end_bucket; ++ bucket) {
+                const struct ripcheck_peak *peak = &level->buckets[bucket * channels + channel];
+                if (peak->min < min) min = peak->min;
+                if (peak->max > max) max = peak->max;
+            }
+
+            const size_t y1 = zero - (max > 0 ? (size_t)max * lane_height / INT16_MAX : 0);
+            const size_t y2 = zero + (min < 0 ? (size_t)-min * lane_height / (-INT16_MIN) : 0);
+
+            ripcheck_canvas_fill_rect(&canvas, x, y1, x, y2, marked[x * channels + channel] ?
+                image_options->error_color : image_options->wave_color);
+        }
+    }
+
+    for (size_t channel = 0; channel < channels; ++ channel) {
+        const size_t zero = channel * lane + lane_height;
+        ripcheck_canvas_fill_rect(&canvas, 0, zero, width - 1, zero, image_options->zero_color);
+    }
+
+    ripcheck_canvas_write(&canvas, filename);
+    ripcheck_canvas_cleanup(&canvas);
+    free(marked);
+}
+
+void ripcheck_image_cleanup(
+    struct ripcheck_image_options *image_options)
+{
+    free(image_options->markers);
+    image_options->markers         = NULL;
+    image_options->marker_count    = 0;
+    image_options->marker_capacity = 0;
+}
+
+void ripcheck_image_begin(
+    void        *data,
+    const struct ripcheck_context *context)
+{
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
+    image_options->marker_count = 0;
+    ripcheck_text_begin(data, context);
+}
+
 void ripcheck_image_possible_pop(
     void        *data,
     const struct ripcheck_context *context,
@@ -946,9 +1059,19 @@ void ripcheck_image_possible_pop(
     uint16_t     channel,
     size_t       last_window_sample)
 {
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
     ripcheck_text_possible_pop(data, context, window_offset, channel, last_window_sample);
-    print_image(data, context, window_offset, "pop", channel, last_window_sample,
-        context->poplocs[channel], context->poplocs[channel]);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "pop", channel, last_window_sample,
+            context->poplocs[channel], context->poplocs[channel]);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, context->poplocs[channel], context->poplocs[channel]);
+    }
 }
 
 void ripcheck_image_possible_drop(
@@ -959,10 +1082,20 @@ void ripcheck_image_possible_drop(
     size_t       last_window_sample,
     size_t       droped_sample)
 {
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
     ripcheck_text_possible_drop(data, context, window_offset, channel,
         last_window_sample, droped_sample);
-    print_image(data, context, window_offset, "drop", channel,
-        last_window_sample, droped_sample, droped_sample);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "drop", channel,
+            last_window_sample, droped_sample, droped_sample);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, droped_sample, droped_sample);
+    }
 }
 
 void ripcheck_image_dupes(
@@ -972,9 +1105,111 @@ void ripcheck_image_dupes(
     uint16_t     channel,
     size_t       last_window_sample)
 {
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
     ripcheck_text_dupes(data, context, window_offset, channel, last_window_sample);
-    print_image(data, context, window_offset, "dupes", channel, last_window_sample,
-    context->dupelocs[channel], context->dupelocs[channel] + context->dupecounts[channel] - 1);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "dupes", channel, last_window_sample,
+        context->dupelocs[channel], context->dupelocs[channel] + context->dupecounts[channel] - 1);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, context->dupelocs[channel],
+            context->dupelocs[channel] + context->dupecounts[channel] - 1);
+    }
+}
+
+void ripcheck_image_clipping(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
+    ripcheck_text_clipping(data, context, window_offset, channel, last_window_sample,
+        first_sample, last_sample);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "clipping", channel, last_window_sample,
+            first_sample, last_sample);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, first_sample, last_sample);
+    }
+}
+
+void ripcheck_image_dropout(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
+    ripcheck_text_dropout(data, context, window_offset, channel, last_window_sample,
+        first_sample, last_sample);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "dropout", channel, last_window_sample,
+            first_sample, last_sample);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, first_sample, last_sample);
+    }
+}
+
+void ripcheck_image_click(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
+    ripcheck_text_click(data, context, window_offset, channel, last_window_sample,
+        first_sample, last_sample);
+
+    if (image_options->events) {
+        print_image(data, context, window_offset, "click", channel, last_window_sample,
+            first_sample, last_sample);
+    }
+
+    if (image_options->overview) {
+        add_markers(image_options, context, channel, first_sample, last_sample);
+    }
+}
+
+void ripcheck_image_complete(
+    void        *data,
+    const struct ripcheck_context *context)
+{
+    struct ripcheck_image_options *image_options =
+        (struct ripcheck_image_options *)data;
+
+    ripcheck_text_complete(data, context);
+
+    if (image_options->overview && context->pyramid) {
+        print_overview(image_options, context, context->pyramid);
+    }
+
+    image_options->marker_count = 0;
 }
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
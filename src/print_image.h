@@ -20,6 +20,14 @@
 #define RIPCHECK_PRINT_IMAGE_H__
 
 #include "ripcheck.h"
+#include "image_sink.h"
+
+// a problem found in the current file, marked in its overview image
+struct ripcheck_image_marker {
+    size_t   first_sample;
+    size_t   last_sample;
+    uint16_t channel;
+};
 
 struct ripcheck_image_options {
     size_t sample_width;
@@ -30,8 +38,27 @@ struct ripcheck_image_options {
     uint8_t error_color[3];
     uint8_t error_bg_color[3];
     const char *filename;
+    const struct ripcheck_image_sink *sink;
+
+    // write an image around each problem
+    int events;
+
+    // write one image of the whole file with all problems marked, drawn
+    // from the waveform pyramid when the file is complete
+    int overview;
+    size_t overview_width;
+    size_t overview_height;
+    const char *overview_filename;
+
+    // problems of the current file
+    struct ripcheck_image_marker *markers;
+    size_t marker_count;
+    size_t marker_capacity;
 };
 
+void ripcheck_image_cleanup(
+    struct ripcheck_image_options *image_options);
+
 int ripcheck_validate_image_filename_format(
     const char *format);
 
@@ -39,6 +66,10 @@ int ripcheck_parse_image_options(
     const char *str,
     struct ripcheck_image_options *image_options);
 
+void ripcheck_image_begin(
+    void        *data,
+    const struct ripcheck_context *context);
+
 void ripcheck_image_possible_pop(
     void        *data,
     const struct ripcheck_context *context,
@@ -61,6 +92,37 @@ void ripcheck_image_dupes(
     uint16_t     channel,
     size_t       last_window_sample);
 
+void ripcheck_image_clipping(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_image_dropout(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_image_click(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_image_complete(
+    void        *data,
+    const struct ripcheck_context *context);
+
 #endif
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
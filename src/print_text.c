@@ -19,6 +19,9 @@
 #include <stdarg.h>
 
 #include "ripcheck.h"
+#include "peaks.h"
+#include "stats.h"
+#include "spectrum.h"
 
 void ripcheck_print_event(
     const struct ripcheck_context *context, size_t window_offset,
@@ -36,12 +39,31 @@ void ripcheck_print_event(
             time, end_time);
     }
 
+    if (context->track > 0) {
+        const double track_time = (1000.0L * (first_error_sample - context->track_start)) / context->fmt.sample_rate;
+        printf(", track = %u, track time = %g ms", context->track, track_time);
+    }
+
     const size_t channels = context->fmt.channels;
     const size_t window_ints = context->window_size * channels;
     const size_t samples = last_window_sample >= context->window_size ?
         context->window_size : last_window_sample + 1;
     
-    printf(", channel = %u, samples[%"PRIzu" ... %"PRIzu"] = {", channel,
+    printf(", channel = %u", channel);
+
+    // the other channels the problem was found in, the samples are of channel
+    if (context->channel_mask & ~((uint64_t)1 << channel)) {
+        const char *sep = " (also ";
+        for (size_t other = 0; other < channels && other < 64; ++ other) {
+            if (other != channel && (context->channel_mask & ((uint64_t)1 << other))) {
+                printf("%s%"PRIzu, sep, other);
+                sep = ", ";
+            }
+        }
+        printf(")");
+    }
+
+    printf(", samples[%"PRIzu" ... %"PRIzu"] = {",
         last_window_sample - samples + 1, last_window_sample);
 
     const size_t offset = (window_offset + channel + channels +
@@ -126,11 +148,128 @@ void ripcheck_text_dupes(
         context->dupelocs[channel], context->dupelocs[channel] + context->dupecounts[channel] - 1);
 }
 
+void ripcheck_text_clipping(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    (void)data;
+    ripcheck_print_event(context, window_offset, "clipping", channel, last_window_sample,
+        first_sample, last_sample);
+}
+
+void ripcheck_text_dropout(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    (void)data;
+    ripcheck_print_event(context, window_offset, "dropout", channel, last_window_sample,
+        first_sample, last_sample);
+}
+
+void ripcheck_text_click(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    (void)data;
+    ripcheck_print_event(context, window_offset, "click", channel, last_window_sample,
+        first_sample, last_sample);
+}
+
+static void print_stats(const struct ripcheck_stats *stats)
+{
+    const double full_scale = (double)((uint64_t)1 << (stats->bits_per_sample - 1));
+    const uint32_t bits_mask = stats->bits_per_sample < 32 ? ~(~0u << stats->bits_per_sample) : ~0u;
+
+    if (stats->frames == 0) {
+        return;
+    }
+
+    for (size_t channel = 0; channel < stats->channels; ++ channel) {
+        const struct ripcheck_channel_stats *ch = &stats->channel[channel];
+        const int64_t  peak = -(int64_t)ch->min > ch->max ? -(int64_t)ch->min : ch->max;
+        const uint32_t rms  = ripcheck_isqrt((uint64_t)(ch->squares / stats->frames));
+        const double   dc   = (double)ch->sum / stats->frames;
+
+        printf("channel %"PRIzu": peak = %"PRId64" (%g%%), RMS = %"PRIu32" (%g%%), DC offset = %g (%g%%)",
+            channel, peak, 100.0 * peak / full_scale, rms, 100.0 * rms / full_scale,
+            dc, 100.0 * dc / full_scale);
+        printf(", zeros = %g%%, repeats = %"PRIu64" (longest = %"PRIu64")",
+            100.0 * ch->zeros / stats->frames, ch->repeats, ch->longest_repeat);
+        printf(", used bits = 0x%"PRIx32" (%u of %u bits)\n",
+            ch->used_bits & bits_mask, ripcheck_stats_effective_bits(stats, channel),
+            stats->bits_per_sample);
+    }
+}
+
+static void print_bandwidth(const struct ripcheck_spectrum *spectrum)
+{
+    if (spectrum->windows == 0) {
+        return;
+    }
+
+    for (size_t channel = 0; channel < spectrum->channels; ++ channel) {
+        const uint32_t bandwidth = ripcheck_spectrum_bandwidth(spectrum, channel);
+
+        if (bandwidth == 0) {
+            printf("channel %"PRIzu": bandwidth = silent\n", channel);
+        }
+        else {
+            printf("channel %"PRIzu": bandwidth = %"PRIu32" Hz of %"PRIu32" Hz (%g%%)\n",
+                channel, bandwidth, spectrum->sample_rate / 2,
+                200.0 * bandwidth / spectrum->sample_rate);
+        }
+    }
+}
+
 void ripcheck_text_complete(
     void *data,
 	const struct ripcheck_context *context)
 {
     (void)data;
+    if (context->digests.valid) {
+        const struct ripcheck_checksums *digests = &context->digests;
+
+        printf("CRC32 = %08"PRIX32"\n", digests->crc32);
+        printf("MD5 = ");
+        for (size_t i = 0; i < sizeof(digests->md5); ++ i) {
+            printf("%02x", digests->md5[i]);
+        }
+        printf("\n");
+
+        if (digests->accuraterip) {
+            printf("AccurateRip v1 = %08"PRIX32", v2 = %08"PRIX32"\n",
+                digests->accuraterip_v1, digests->accuraterip_v2);
+        }
+    }
+
+    if (context->channel_stats) {
+        print_stats(context->channel_stats);
+    }
+
+    if (context->average_spectrum) {
+        print_bandwidth(context->average_spectrum);
+    }
+
+    if (context->compare_filename) {
+        printf("compared with: %s, offset = %"PRId64" samples\n",
+            context->compare_filename, context->compare_offset);
+    }
+
     if (context->bad_areas == 0) {
         printf("done: all ok\n");
     }
@@ -142,6 +281,42 @@ void ripcheck_text_complete(
     }
 }
 
+void ripcheck_text_covered(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    (void)data;
+    const double time     = (1000.0L * first_sample) / context->fmt.sample_rate;
+    const double end_time = (1000.0L * last_sample)  / context->fmt.sample_rate;
+    printf("covered: samples = %"PRIzu" ... %"PRIzu" (%"PRIzu" samples, time = %g ms ... %g ms)\n",
+        first_sample, last_sample, last_sample - first_sample + 1, time, end_time);
+}
+
+void ripcheck_text_difference(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    (void)data;
+    const double time     = (1000.0L * first_sample) / context->fmt.sample_rate;
+    const double end_time = (1000.0L * last_sample)  / context->fmt.sample_rate;
+    printf("difference: samples = %"PRIzu" ... %"PRIzu" (%"PRIzu" samples, time = %g ms ... %g ms)",
+        first_sample, last_sample, last_sample - first_sample + 1, time, end_time);
+
+    const char *sep = ", channels = ";
+    for (size_t channel = 0; channel < context->fmt.channels && channel < 64; ++ channel) {
+        if (context->channel_mask & ((uint64_t)1 << channel)) {
+            printf("%s%"PRIzu, sep, channel);
+            sep = ", ";
+        }
+    }
+
+    printf("\n");
+}
+
 void ripcheck_text_error(
     void *data,
 	const struct ripcheck_context *context,
@@ -183,7 +358,12 @@ struct ripcheck_callbacks ripcheck_callbacks_print_text = {
     ripcheck_text_dupes,
     ripcheck_text_complete,
     ripcheck_text_error,
-    ripcheck_text_warning
+    ripcheck_text_warning,
+    ripcheck_text_covered,
+    ripcheck_text_clipping,
+    ripcheck_text_dropout,
+    ripcheck_text_click,
+    ripcheck_text_difference
 };
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
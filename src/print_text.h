@@ -59,10 +59,49 @@ void ripcheck_text_dupes(
     uint16_t     channel,
     size_t       last_window_sample);
 
+void ripcheck_text_clipping(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_text_dropout(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_text_click(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
 void ripcheck_text_complete(
     void *data,
     const struct ripcheck_context *context);
 
+void ripcheck_text_covered(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample);
+
+void ripcheck_text_difference(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample);
+
 void ripcheck_text_error(
     void *data,
     const struct ripcheck_context *context,
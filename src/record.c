@@ -0,0 +1,900 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+
+#include "record.h"
+#include "peaks.h"
+#include "stats.h"
+#include "spectrum.h"
+
+enum record_event_type {
+    RECORD_BEGIN,
+    RECORD_SAMPLE_DATA,
+    RECORD_POSSIBLE_POP,
+    RECORD_POSSIBLE_DROP,
+    RECORD_DUPES,
+    RECORD_COMPLETE,
+    RECORD_ERROR,
+    RECORD_WARNING,
+    RECORD_COVERED,
+    RECORD_CLIPPING,
+    RECORD_DROPOUT,
+    RECORD_CLICK,
+    RECORD_DIFFERENCE
+};
+
+struct record_event {
+    enum record_event_type type;
+
+    // snapshot of the scalar fields of the context
+    struct ripcheck_context context;
+
+    // copy of the window and of the per channel state of the reported channel
+    int     *window;
+    size_t   window_offset;
+    uint16_t channel;
+    size_t   last_window_sample;
+    size_t   droped_sample;
+    size_t   poploc;
+    size_t   dupeloc;
+    size_t   dupecount;
+
+    size_t   first_sample;
+    size_t   last_sample;
+
+    uint32_t data_size;
+    int      errnum;
+    char    *message;
+
+    // copy of the waveform pyramid of the complete event
+    struct ripcheck_peaks *peaks;
+    // copy of the channel statistics of the complete event
+    struct ripcheck_stats *stats;
+    // copy of the average spectrum of the complete event
+    struct ripcheck_spectrum *spectrum;
+};
+
+struct ripcheck_record {
+    char   *filename;
+    struct record_event *events;
+    size_t  count;
+    size_t  capacity;
+    int     errnum;
+};
+
+struct ripcheck_record *ripcheck_record_create(void)
+{
+    return calloc(1, sizeof(struct ripcheck_record));
+}
+
+int ripcheck_record_error(const struct ripcheck_record *record)
+{
+    return record->errnum;
+}
+
+void ripcheck_record_free(struct ripcheck_record *record)
+{
+    if (!record) return;
+
+    for (size_t i = 0; i < record->count; ++ i) {
+        free(record->events[i].window);
+        free(record->events[i].message);
+
+        if (record->events[i].peaks) {
+            ripcheck_peaks_cleanup(record->events[i].peaks);
+            free(record->events[i].peaks);
+        }
+
+        if (record->events[i].stats) {
+            ripcheck_stats_cleanup(record->events[i].stats);
+            free(record->events[i].stats);
+        }
+
+        if (record->events[i].spectrum) {
+            ripcheck_spectrum_cleanup(record->events[i].spectrum);
+            free(record->events[i].spectrum);
+        }
+    }
+
+    free(record->events);
+    free(record->filename);
+    free(record);
+}
+
+static struct record_event *record_event(
+    struct ripcheck_record *record,
+    const struct ripcheck_context *context,
+    enum record_event_type type)
+{
+    if (record->errnum != 0) {
+        return NULL;
+    }
+
+    if (!record->filename && context->filename) {
+        record->filename = strdup(context->filename);
+
+        if (!record->filename) {
+            record->errnum = errno;
+            return NULL;
+        }
+    }
+
+    if (record->count == record->capacity) {
+        size_t capacity = record->capacity ? record->capacity * 2 : 16;
+        struct record_event *events = realloc(record->events, capacity * sizeof(struct record_event));
+
+        if (!events) {
+            record->errnum = errno;
+            return NULL;
+        }
+
+        record->events   = events;
+        record->capacity = capacity;
+    }
+
+    struct record_event *event = &record->events[record->count ++];
+    memset(event, 0, sizeof(*event));
+    event->type    = type;
+    event->context = *context;
+
+    return event;
+}
+
+static void record_window(
+    struct ripcheck_record *record,
+    struct record_event *event,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample)
+{
+    const size_t window_ints = context->window_size * context->fmt.channels;
+
+    event->window_offset      = window_offset;
+    event->channel            = channel;
+    event->last_window_sample = last_window_sample;
+    event->poploc             = context->poplocs[channel];
+    event->dupeloc            = context->dupelocs[channel];
+    event->dupecount          = context->dupecounts[channel];
+    event->window             = malloc(sizeof(int) * window_ints);
+
+    if (!event->window) {
+        record->errnum = errno;
+        -- record->count;
+        return;
+    }
+
+    memcpy(event->window, context->window, sizeof(int) * window_ints);
+}
+
+static char *record_vformat(const char *fmt, va_list ap)
+{
+    va_list ap2;
+    va_copy(ap2, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap2);
+    va_end(ap2);
+
+    if (n < 0) {
+        return NULL;
+    }
+
+    char *str = malloc(n + 1);
+    if (str) {
+        vsnprintf(str, n + 1, fmt, ap);
+    }
+
+    return str;
+}
+
+static void record_begin(
+    void *data,
+    const struct ripcheck_context *context)
+{
+    record_event(data, context, RECORD_BEGIN);
+}
+
+static void record_sample_data(
+    void *data,
+    const struct ripcheck_context *context,
+    uint32_t data_size)
+{
+    struct record_event *event = record_event(data, context, RECORD_SAMPLE_DATA);
+
+    if (event) {
+        event->data_size = data_size;
+    }
+}
+
+static void record_possible_pop(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_POSSIBLE_POP);
+
+    if (event) {
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+static void record_possible_drop(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       droped_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_POSSIBLE_DROP);
+
+    if (event) {
+        event->droped_sample = droped_sample;
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+static void record_dupes(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_DUPES);
+
+    if (event) {
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+// drop a complete event whose results could not be copied
+static void record_drop_complete(
+    struct ripcheck_record *record,
+    struct record_event *event,
+    int errnum)
+{
+    if (event->peaks) {
+        ripcheck_peaks_cleanup(event->peaks);
+        free(event->peaks);
+        event->peaks = NULL;
+    }
+
+    if (event->stats) {
+        ripcheck_stats_cleanup(event->stats);
+        free(event->stats);
+        event->stats = NULL;
+    }
+
+    if (event->spectrum) {
+        ripcheck_spectrum_cleanup(event->spectrum);
+        free(event->spectrum);
+        event->spectrum = NULL;
+    }
+
+    record->errnum = errnum;
+    -- record->count;
+}
+
+void ripcheck_record_strip(struct ripcheck_record *record)
+{
+    for (size_t i = 0; i < record->count; ++ i) {
+        if (record->events[i].type == RECORD_COMPLETE) {
+            struct record_event *event = &record->events[i];
+
+            if (event->peaks) {
+                ripcheck_peaks_cleanup(event->peaks);
+                free(event->peaks);
+                event->peaks = NULL;
+            }
+
+            if (event->stats) {
+                ripcheck_stats_cleanup(event->stats);
+                free(event->stats);
+                event->stats = NULL;
+            }
+
+            if (event->spectrum) {
+                ripcheck_spectrum_cleanup(event->spectrum);
+                free(event->spectrum);
+                event->spectrum = NULL;
+            }
+        }
+    }
+}
+
+static void record_complete(
+    void *data,
+    const struct ripcheck_context *context)
+{
+    struct ripcheck_record *record = data;
+    struct record_event *event = record_event(record, context, RECORD_COMPLETE);
+    int errnum = 0;
+
+    if (!event) {
+        return;
+    }
+
+    if (context->pyramid) {
+        errnum = (event->peaks = malloc(sizeof(struct ripcheck_peaks))) ?
+            ripcheck_peaks_copy(event->peaks, context->pyramid) : ENOMEM;
+    }
+
+    if (errnum == 0 && context->channel_stats) {
+        errnum = (event->stats = malloc(sizeof(struct ripcheck_stats))) ?
+            ripcheck_stats_copy(event->stats, context->channel_stats) : ENOMEM;
+    }
+
+    if (errnum == 0 && context->average_spectrum) {
+        errnum = (event->spectrum = malloc(sizeof(struct ripcheck_spectrum))) ?
+            ripcheck_spectrum_copy(event->spectrum, context->average_spectrum) : ENOMEM;
+    }
+
+    if (errnum != 0) {
+        record_drop_complete(record, event, errnum);
+    }
+}
+
+static void record_error(
+    void *data,
+    const struct ripcheck_context *context,
+    int errnum,
+    const char *fmt, ...)
+{
+    struct ripcheck_record *record = data;
+    struct record_event *event = record_event(record, context, RECORD_ERROR);
+
+    if (event) {
+        va_list ap;
+        va_start(ap, fmt);
+        event->errnum  = errnum;
+        event->message = record_vformat(fmt, ap);
+        va_end(ap);
+
+        if (!event->message) {
+            record->errnum = errno;
+            -- record->count;
+        }
+    }
+}
+
+static void record_warning(
+    void *data,
+    const struct ripcheck_context *context,
+    const char *fmt, ...)
+{
+    struct ripcheck_record *record = data;
+    struct record_event *event = record_event(record, context, RECORD_WARNING);
+
+    if (event) {
+        va_list ap;
+        va_start(ap, fmt);
+        event->message = record_vformat(fmt, ap);
+        va_end(ap);
+
+        if (!event->message) {
+            record->errnum = errno;
+            -- record->count;
+        }
+    }
+}
+
+static void record_covered(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_COVERED);
+
+    if (event) {
+        event->first_sample = first_sample;
+        event->last_sample  = last_sample;
+    }
+}
+
+static void record_clipping(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_CLIPPING);
+
+    if (event) {
+        event->first_sample = first_sample;
+        event->last_sample  = last_sample;
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+static void record_dropout(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_DROPOUT);
+
+    if (event) {
+        event->first_sample = first_sample;
+        event->last_sample  = last_sample;
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+static void record_click(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_CLICK);
+
+    if (event) {
+        event->first_sample = first_sample;
+        event->last_sample  = last_sample;
+        record_window(data, event, context, window_offset, channel, last_window_sample);
+    }
+}
+
+static void record_difference(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample)
+{
+    struct record_event *event = record_event(data, context, RECORD_DIFFERENCE);
+
+    if (event) {
+        event->first_sample = first_sample;
+        event->last_sample  = last_sample;
+    }
+}
+
+struct ripcheck_callbacks ripcheck_callbacks_record = {
+    NULL,
+    record_begin,
+    record_sample_data,
+    record_possible_pop,
+    record_possible_drop,
+    record_dupes,
+    record_complete,
+    record_error,
+    record_warning,
+    record_covered,
+    record_clipping,
+    record_dropout,
+    record_click,
+    record_difference
+};
+
+void ripcheck_record_replay(
+    const struct ripcheck_record *record,
+    struct ripcheck_callbacks *callbacks)
+{
+    ripcheck_record_replay_as(record, record->filename, callbacks);
+}
+
+const struct ripcheck_peaks *ripcheck_record_peaks(const struct ripcheck_record *record)
+{
+    for (size_t i = record->count; i > 0; -- i) {
+        const struct record_event *event = &record->events[i - 1];
+
+        if (event->type == RECORD_COMPLETE) {
+            return event->peaks;
+        }
+    }
+
+    return NULL;
+}
+
+const struct ripcheck_checksums *ripcheck_record_checksums(const struct ripcheck_record *record)
+{
+    for (size_t i = record->count; i > 0; -- i) {
+        const struct record_event *event = &record->events[i - 1];
+
+        if (event->type == RECORD_COMPLETE) {
+            return event->context.digests.valid ? &event->context.digests : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+void ripcheck_record_replay_as(
+    const struct ripcheck_record *record,
+    const char *filename,
+    struct ripcheck_callbacks *callbacks)
+{
+    int     *window     = NULL;
+    size_t  *poplocs    = NULL;
+    size_t  *dupelocs   = NULL;
+    size_t  *dupecounts = NULL;
+
+    for (size_t i = 0; i < record->count; ++ i) {
+        const struct record_event *event = &record->events[i];
+        struct ripcheck_context context = event->context;
+
+        context.filename   = filename;
+        context.tracks     = NULL;
+        context.pyramid    = event->peaks;
+        context.channel_stats = event->stats;
+        context.average_spectrum = event->spectrum;
+        context.window     = NULL;
+        context.poplocs    = NULL;
+        context.dupelocs   = NULL;
+        context.dupecounts = NULL;
+        context.pop_limits  = NULL;
+        context.drop_limits = NULL;
+        context.dupe_limits = NULL;
+        context.compare_filename = NULL;
+
+        if (event->window) {
+            const size_t channels    = context.fmt.channels;
+            const size_t window_ints = context.window_size * channels;
+
+            // all events of a file share the same format
+            if (!window) {
+                window     = malloc(sizeof(int) * window_ints);
+                poplocs    = calloc(channels, sizeof(size_t));
+                dupelocs   = calloc(channels, sizeof(size_t));
+                dupecounts = calloc(channels, sizeof(size_t));
+
+                if (!window || !poplocs || !dupelocs || !dupecounts) {
+                    callbacks->error(callbacks->data, &context, ENOMEM, "%s", strerror(ENOMEM));
+                    break;
+                }
+            }
+
+            memcpy(window, event->window, sizeof(int) * window_ints);
+            poplocs[event->channel]    = event->poploc;
+            dupelocs[event->channel]   = event->dupeloc;
+            dupecounts[event->channel] = event->dupecount;
+
+            context.window     = window;
+            context.poplocs    = poplocs;
+            context.dupelocs   = dupelocs;
+            context.dupecounts = dupecounts;
+        }
+
+        switch (event->type) {
+            case RECORD_BEGIN:
+                callbacks->begin(callbacks->data, &context);
+                break;
+
+            case RECORD_SAMPLE_DATA:
+                callbacks->sample_data(callbacks->data, &context, event->data_size);
+                break;
+
+            case RECORD_POSSIBLE_POP:
+                callbacks->possible_pop(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample);
+                break;
+
+            case RECORD_POSSIBLE_DROP:
+                callbacks->possible_drop(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample, event->droped_sample);
+                break;
+
+            case RECORD_DUPES:
+                callbacks->dupes(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample);
+                break;
+
+            case RECORD_COMPLETE:
+                callbacks->complete(callbacks->data, &context);
+                break;
+
+            case RECORD_ERROR:
+                callbacks->error(callbacks->data, &context, event->errnum, "%s", event->message);
+                break;
+
+            case RECORD_WARNING:
+                callbacks->warning(callbacks->data, &context, "%s", event->message);
+                break;
+
+            case RECORD_COVERED:
+                callbacks->covered(callbacks->data, &context, event->first_sample, event->last_sample);
+                break;
+
+            case RECORD_CLIPPING:
+                callbacks->clipping(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample, event->first_sample, event->last_sample);
+                break;
+
+            case RECORD_DROPOUT:
+                callbacks->dropout(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample, event->first_sample, event->last_sample);
+                break;
+
+            case RECORD_CLICK:
+                callbacks->click(callbacks->data, &context, event->window_offset,
+                    event->channel, event->last_window_sample, event->first_sample, event->last_sample);
+                break;
+
+            case RECORD_DIFFERENCE:
+                callbacks->difference(callbacks->data, &context, event->first_sample, event->last_sample);
+                break;
+        }
+    }
+
+    if (record->errnum != 0) {
+        struct ripcheck_context context;
+        memset(&context, 0, sizeof(context));
+        context.filename = filename;
+        callbacks->error(callbacks->data, &context, record->errnum, "%s", strerror(record->errnum));
+    }
+
+    free(window);
+    free(poplocs);
+    free(dupelocs);
+    free(dupecounts);
+}
+
+static int write_size(size_t value, FILE *f)
+{
+    uint64_t buf = value;
+    return fwrite(&buf, sizeof(buf), 1, f) == 1 ? 0 : EIO;
+}
+
+static int read_size(size_t *value, FILE *f)
+{
+    uint64_t buf = 0;
+
+    if (fread(&buf, sizeof(buf), 1, f) != 1) {
+        return ferror(f) ? EIO : EINVAL;
+    }
+    else if (buf > SIZE_MAX) {
+        return EINVAL;
+    }
+
+    *value = (size_t)buf;
+    return 0;
+}
+
+static size_t event_window_ints(const struct record_event *event)
+{
+    return event->context.window_size * event->context.fmt.channels;
+}
+
+int ripcheck_record_write(const struct ripcheck_record *record, FILE *f)
+{
+    if (record->errnum != 0) {
+        return record->errnum;
+    }
+
+    int errnum = write_size(record->count, f);
+
+    for (size_t i = 0; errnum == 0 && i < record->count; ++ i) {
+        const struct record_event *event = &record->events[i];
+        const size_t msglen = event->message ? strlen(event->message) : 0;
+
+        // the pointers in the raw event are ignored when reading it back
+        if (fwrite(event, sizeof(*event), 1, f) != 1) {
+            errnum = EIO;
+        }
+        else if (event->window &&
+                 fwrite(event->window, sizeof(int), event_window_ints(event), f) != event_window_ints(event)) {
+            errnum = EIO;
+        }
+        else if (event->message && ((errnum = write_size(msglen, f)) != 0 ||
+                 fwrite(event->message, 1, msglen, f) != msglen)) {
+            errnum = errnum ? errnum : EIO;
+        }
+        else if (event->peaks) {
+            errnum = ripcheck_peaks_write(event->peaks, f);
+        }
+
+        if (errnum == 0 && event->stats) {
+            const struct ripcheck_stats *stats = event->stats;
+
+            if (fwrite(stats, sizeof(*stats), 1, f) != 1 ||
+                fwrite(stats->channel, sizeof(*stats->channel), stats->channels, f) != stats->channels) {
+                errnum = EIO;
+            }
+        }
+
+        if (errnum == 0 && event->spectrum) {
+            const struct ripcheck_spectrum *spectrum = event->spectrum;
+            const size_t count = (size_t)spectrum->channels * RIPCHECK_SPECTRUM_BINS;
+
+            if (fwrite(spectrum, sizeof(*spectrum), 1, f) != 1 ||
+                fwrite(spectrum->power, sizeof(double), count, f) != count) {
+                errnum = EIO;
+            }
+        }
+    }
+
+    return errnum;
+}
+
+int ripcheck_record_read(struct ripcheck_record **recordptr, FILE *f, const char *filename)
+{
+    struct ripcheck_record *record = ripcheck_record_create();
+    size_t count = 0;
+    int errnum = 0;
+
+    if (!record) {
+        return errno;
+    }
+
+    record->filename = strdup(filename);
+    if (!record->filename) {
+        errnum = errno;
+        ripcheck_record_free(record);
+        return errnum;
+    }
+
+    if ((errnum = read_size(&count, f)) != 0) {
+        ripcheck_record_free(record);
+        return errnum;
+    }
+
+    if (count > 0) {
+        record->events = calloc(count, sizeof(struct record_event));
+
+        if (!record->events) {
+            errnum = errno;
+            ripcheck_record_free(record);
+            return errnum;
+        }
+        record->capacity = count;
+    }
+
+    while (errnum == 0 && record->count < count) {
+        struct record_event *event = &record->events[record->count];
+
+        if (fread(event, sizeof(*event), 1, f) != 1) {
+            memset(event, 0, sizeof(*event));
+            errnum = ferror(f) ? EIO : EINVAL;
+            break;
+        }
+
+        const int has_window  = event->window  != NULL;
+        const int has_message = event->message != NULL;
+        const int has_peaks   = event->peaks   != NULL;
+        const int has_stats   = event->stats   != NULL;
+        const int has_spectrum = event->spectrum != NULL;
+
+        event->window  = NULL;
+        event->message = NULL;
+        event->peaks   = NULL;
+        event->stats   = NULL;
+        event->spectrum = NULL;
+        ++ record->count;
+
+        if (has_window) {
+            const size_t window_ints = event_window_ints(event);
+
+            if (event->channel >= event->context.fmt.channels) {
+                errnum = EINVAL;
+            }
+            else if (!(event->window = malloc(sizeof(int) * window_ints))) {
+                errnum = errno;
+            }
+            else if (fread(event->window, sizeof(int), window_ints, f) != window_ints) {
+                errnum = ferror(f) ? EIO : EINVAL;
+            }
+        }
+
+        if (errnum == 0 && has_message) {
+            size_t msglen = 0;
+
+            if ((errnum = read_size(&msglen, f)) != 0) {
+                break;
+            }
+            else if (!(event->message = malloc(msglen + 1))) {
+                errnum = errno;
+            }
+            else if (fread(event->message, 1, msglen, f) != msglen) {
+                errnum = ferror(f) ? EIO : EINVAL;
+            }
+            else {
+                event->message[msglen] = '\0';
+            }
+        }
+
+        if (errnum == 0 && has_peaks) {
+            if (!(event->peaks = malloc(sizeof(struct ripcheck_peaks)))) {
+                errnum = errno;
+            }
+            else if ((errnum = ripcheck_peaks_read(event->peaks, f)) != 0) {
+                free(event->peaks);
+                event->peaks = NULL;
+            }
+        }
+
+        if (errnum == 0 && has_stats) {
+            struct ripcheck_stats *stats = malloc(sizeof(*stats));
+
+            if (!stats) {
+                errnum = errno;
+            }
+            else if (fread(stats, sizeof(*stats), 1, f) != 1) {
+                errnum = ferror(f) ? EIO : EINVAL;
+                free(stats);
+            }
+            else if (stats->channels != event->context.fmt.channels ||
+                     !(stats->channel = malloc(stats->channels * sizeof(*stats->channel)))) {
+                errnum = stats->channels != event->context.fmt.channels ? EINVAL : errno;
+                free(stats);
+            }
+            else if (fread(stats->channel, sizeof(*stats->channel), stats->channels, f) != stats->channels) {
+                errnum = ferror(f) ? EIO : EINVAL;
+                ripcheck_stats_cleanup(stats);
+                free(stats);
+            }
+            else {
+                event->stats = stats;
+            }
+        }
+
+        if (errnum == 0 && has_spectrum) {
+            struct ripcheck_spectrum raw;
+            struct ripcheck_spectrum *spectrum = NULL;
+
+            // only the results were written, not the state of the batch
+            if (fread(&raw, sizeof(raw), 1, f) != 1) {
+                errnum = ferror(f) ? EIO : EINVAL;
+            }
+            else if (raw.channels != event->context.fmt.channels) {
+                errnum = EINVAL;
+            }
+            else if (!(spectrum = calloc(1, sizeof(*spectrum))) ||
+                     !(spectrum->power = malloc(raw.channels * RIPCHECK_SPECTRUM_BINS * sizeof(double)))) {
+                errnum = errno;
+                free(spectrum);
+            }
+            else if (fread(spectrum->power, sizeof(double), raw.channels * RIPCHECK_SPECTRUM_BINS, f) !=
+                     raw.channels * RIPCHECK_SPECTRUM_BINS) {
+                errnum = ferror(f) ? EIO : EINVAL;
+                ripcheck_spectrum_cleanup(spectrum);
+                free(spectrum);
+            }
+            else {
+                spectrum->sample_rate = raw.sample_rate;
+                spectrum->channels    = raw.channels;
+                spectrum->windows     = raw.windows;
+                event->spectrum = spectrum;
+            }
+        }
+    }
+
+    if (errnum != 0) {
+        ripcheck_record_free(record);
+        return errnum;
+    }
+
+    *recordptr = record;
+    return 0;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
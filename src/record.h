@@ -0,0 +1,66 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_RECORD_H__
+#define RIPCHECK_RECORD_H__
+
+#include "ripcheck.h"
+
+// Callbacks that record all events of a file so they can be replayed
+// through other callbacks later. data has to point to a struct ripcheck_record.
+extern struct ripcheck_callbacks ripcheck_callbacks_record;
+
+struct ripcheck_record;
+
+struct ripcheck_record *ripcheck_record_create(void);
+
+void ripcheck_record_replay(
+    const struct ripcheck_record *record,
+    struct ripcheck_callbacks *callbacks);
+
+void ripcheck_record_replay_as(
+    const struct ripcheck_record *record,
+    const char *filename,
+    struct ripcheck_callbacks *callbacks);
+
+// Checksums reported by the complete event or NULL if there are none.
+const struct ripcheck_checksums *ripcheck_record_checksums(const struct ripcheck_record *record);
+
+// Waveform pyramid reported by the complete event or NULL if there is none.
+const struct ripcheck_peaks *ripcheck_record_peaks(const struct ripcheck_record *record);
+
+// Free the waveform pyramid, channel statistics and spectrum of the complete
+// event. Replaying the record reports the events and checksums only.
+void ripcheck_record_strip(struct ripcheck_record *record);
+
+// Returns the error that happened while recording, if any.
+int ripcheck_record_error(const struct ripcheck_record *record);
+
+// Serialize the recorded events. The format depends on the build, so it is
+// only suitable for caches that are invalidated with the program.
+int ripcheck_record_write(const struct ripcheck_record *record, FILE *f);
+
+// Read events written by ripcheck_record_write(). Replayed events report
+// filename instead of the file name that was recorded.
+int ripcheck_record_read(struct ripcheck_record **record, FILE *f, const char *filename);
+
+void ripcheck_record_free(struct ripcheck_record *record);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
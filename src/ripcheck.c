@@ -19,9 +19,15 @@
 #include <errno.h>
 #include <strings.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "ripcheck.h"
 #include "ripcheck_endian.h"
+#include "data_reader.h"
+#include "peaks.h"
+#include "stats.h"
+#include "spectrum.h"
+#include "detector.h"
 
 #define RIFF_HEADER_SIZE 20
 #define WAVE_FMT_SIZE    16
@@ -29,19 +35,60 @@
 
 #define PCM 1
 
+// size of the blocks in which the data chunk is read
+#define DATA_BLOCK_SIZE (256 * 1024)
+
 static int ripcheck_data(
     FILE *f,
     uint32_t size,
     struct ripcheck_context   *context,
     struct ripcheck_callbacks *callbacks);
 
-static void ripcheck_context_cleanup(struct ripcheck_context *context)
+void ripcheck_context_cleanup(struct ripcheck_context *context)
 {
-    free(context->frame);
     free(context->window);
     free(context->dupecounts);
     free(context->poplocs);
     free(context->dupelocs);
+    // drop_limits and dupe_limits share the allocation
+    free(context->pop_limits);
+
+    if (context->pyramid)
+    {
+        ripcheck_peaks_cleanup(context->pyramid);
+        free(context->pyramid);
+        context->pyramid = NULL;
+    }
+
+    if (context->channel_stats)
+    {
+        ripcheck_stats_cleanup(context->channel_stats);
+        free(context->channel_stats);
+        context->channel_stats = NULL;
+    }
+
+    if (context->average_spectrum)
+    {
+        ripcheck_spectrum_cleanup(context->average_spectrum);
+        free(context->average_spectrum);
+        context->average_spectrum = NULL;
+    }
+}
+
+// fread() does not set errno when it stops at the end of the file
+static int ripcheck_read_error(
+    FILE *f,
+    const struct ripcheck_context *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    if (ferror(f)) {
+        int errnum = errno;
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    callbacks->error(callbacks->data, context, EINVAL, "Unexpected end of file.");
+    return EINVAL;
 }
 
 static unsigned int to_full_byte(int bits)
@@ -61,6 +108,244 @@ static size_t time_to_samples(const struct ripcheck_context *context, const ripc
     }
 }
 
+// set the current track and compute where its intro ends and its outro starts
+static void ripcheck_enter_track(
+    struct ripcheck_context *context,
+    size_t  blocks,
+    size_t  index,
+    size_t *sample_after_intro,
+    size_t *sample_before_outro,
+    size_t *next_track_start)
+{
+    const struct ripcheck_track *tracks = context->tracks;
+    const size_t rate = context->fmt.sample_rate;
+
+    // samples before the first index of the first track belong to it
+    size_t start = index == 0 ? 0 : tracks[index].start * rate / 75;
+    size_t end   = index + 1 < context->track_count ? tracks[index + 1].start * rate / 75 : blocks;
+
+    if (end > blocks) end = blocks;
+    if (start > end)  start = end;
+
+    const size_t length = end - start;
+
+    *sample_after_intro  = start + (length > context->intro_length ? context->intro_length : length);
+    *sample_before_outro = length > context->outro_length ? end - context->outro_length : start;
+    *next_track_start    = index + 1 < context->track_count ? end : SIZE_MAX;
+
+    context->track       = tracks[index].number;
+    context->track_start = start;
+}
+
+// Frames at the start of a block that are always analyzed in full. Events found
+// there may depend on samples of the previous block.
+#define SWEEP_HEAD_FRAMES 13
+
+// Chunk of samples after which the sweep checks if it found anything.
+#define SWEEP_CHUNK 4096
+
+// Load a packed little endian sample of 2 or 3 bytes without sign extension.
+static inline uint32_t ripcheck_sweep_load(const uint8_t *data, size_t index, const unsigned int bytes)
+{
+    if (bytes == 2)
+    {
+        uint16_t value;
+        memcpy(&value, data + index * 2, 2);
+        return le16toh(value);
+    }
+
+    const uint8_t *sample = data + index * 3;
+    return (uint32_t)sample[0] | (uint32_t)sample[1] << 8 | (uint32_t)sample[2] << 16;
+}
+
+// Coarse sweep over packed 16 or 24 bit samples for zero samples, three equal
+// samples in a row and/or clipped samples. Returns 1 if frames first to
+// count - 1 contain none of them. Zeros and repeats are found on the raw
+// bits, so only clipped samples need the sign. A sample x is clipped if
+// (uint32_t)(x + clip_offset) >= clip_span, which is one compare instead of two.
+static inline int ripcheck_sweep_for(const uint8_t *data, size_t first, size_t count, size_t channels,
+    const unsigned int bytes, const unsigned int zero, const unsigned int triple, const unsigned int clip,
+    const uint32_t clip_offset, const uint32_t clip_span)
+{
+    const size_t end = count * channels;
+    const unsigned int shift = 32 - 8 * bytes;
+
+    for (size_t start = first * channels; start < end; start += SWEEP_CHUNK)
+    {
+        const size_t stop = end - start > SWEEP_CHUNK ? start + SWEEP_CHUNK : end;
+        unsigned int found = 0;
+
+        // no early exit inside of the chunk so it can be vectorized
+        for (size_t index = start; index < stop; ++ index)
+        {
+            const uint32_t x0 = ripcheck_sweep_load(data, index, bytes);
+            const uint32_t x1 = ripcheck_sweep_load(data, index - channels, bytes);
+            const uint32_t x2 = ripcheck_sweep_load(data, index - 2 * channels, bytes);
+            const int32_t  x  = (int32_t)(x0 << shift) >> shift;
+            found |= ((x0 == 0) & zero) | ((x0 == x1) & (x1 == x2) & triple) |
+                (((uint32_t)(x + (int32_t)clip_offset) >= clip_span) & clip);
+        }
+
+        if (found) return 0;
+    }
+
+    return 1;
+}
+
+// Sweep for what the enabled detectors need in order to find anything
+// (RIPCHECK_SWEEP_* flags in features). The flags are passed as constants so
+// each variant of the loop is vectorized.
+static inline int ripcheck_sweep_bytes(const uint8_t *data, size_t first, size_t count, size_t channels,
+    const unsigned int bytes, unsigned int features, int clip_limit)
+{
+    if (features & RIPCHECK_SWEEP_CLIP)
+    {
+        // every sample is clipped
+        if (clip_limit <= 0) return 0;
+
+        // no sample is clipped
+        if (clip_limit > 1 << (8 * bytes - 1)) features &= ~RIPCHECK_SWEEP_CLIP;
+    }
+
+    // samples in -clip_limit + 1 ... clip_limit - 1 map to 0 ... clip_span - 1
+    const uint32_t offset = features & RIPCHECK_SWEEP_CLIP ? (uint32_t)clip_limit - 1     : 0;
+    const uint32_t span   = features & RIPCHECK_SWEEP_CLIP ? 2 * (uint32_t)clip_limit - 1 : 0;
+
+    switch (features)
+    {
+        case RIPCHECK_SWEEP_ZERO:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 1, 0, 0, offset, span);
+
+        case RIPCHECK_SWEEP_TRIPLE:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 0, 1, 0, offset, span);
+
+        case RIPCHECK_SWEEP_ZERO | RIPCHECK_SWEEP_TRIPLE:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 1, 1, 0, offset, span);
+
+        case RIPCHECK_SWEEP_CLIP:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 0, 0, 1, offset, span);
+
+        case RIPCHECK_SWEEP_ZERO | RIPCHECK_SWEEP_CLIP:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 1, 0, 1, offset, span);
+
+        case RIPCHECK_SWEEP_TRIPLE | RIPCHECK_SWEEP_CLIP:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 0, 1, 1, offset, span);
+
+        case 0:
+            return 1;
+
+        default:
+            return ripcheck_sweep_for(data, first, count, channels, bytes, 1, 1, 1, offset, span);
+    }
+}
+
+// The byte count is passed as a constant so each sample size gets its own loops.
+static int ripcheck_sweep(const uint8_t *data, size_t first, size_t count, size_t channels,
+    unsigned int bytes, unsigned int features, int clip_limit)
+{
+    return bytes == 2 ?
+        ripcheck_sweep_bytes(data, first, count, channels, 2, features, clip_limit) :
+        ripcheck_sweep_bytes(data, first, count, channels, 3, features, clip_limit);
+}
+
+void ripcheck_decode(
+    const struct ripcheck_context *context,
+    const uint8_t *data,
+    size_t count,
+    int *samples)
+{
+    const uint16_t channels        = context->fmt.channels;
+    const uint16_t block_align     = context->fmt.block_align;
+    const uint16_t bits_per_sample = context->fmt.bits_per_sample;
+
+    const unsigned int ceil_bits_per_sample = to_full_byte(bits_per_sample);
+    const unsigned int bytes_per_sample     = ceil_bits_per_sample / 8;
+    const unsigned int shift                = ceil_bits_per_sample - bits_per_sample;
+
+    if (bits_per_sample == 16 && block_align == 2 * channels)
+    {
+        const size_t ints = count * channels;
+
+        for (size_t index = 0; index < ints; ++ index)
+        {
+            uint16_t value;
+            memcpy(&value, data + index * 2, 2);
+            samples[index] = (int16_t)le16toh(value);
+        }
+
+        return;
+    }
+
+    // packed 24 bit samples are sign extended by shifting them through the top byte
+    if (bits_per_sample == 24 && block_align == 3 * channels)
+    {
+        const size_t ints = count * channels;
+
+        for (size_t index = 0; index < ints; ++ index)
+        {
+            const uint8_t *bytes = data + index * 3;
+            samples[index] = (int32_t)((uint32_t)bytes[0] << 8 | (uint32_t)bytes[1] << 16 |
+                                       (uint32_t)bytes[2] << 24) >> 8;
+        }
+
+        return;
+    }
+
+    if (bits_per_sample == 32 && block_align == 4 * channels)
+    {
+        const size_t ints = count * channels;
+
+        for (size_t index = 0; index < ints; ++ index)
+        {
+            uint32_t value;
+            memcpy(&value, data + index * 4, 4);
+            samples[index] = (int32_t)le32toh(value);
+        }
+
+        return;
+    }
+
+    // mid is mid-point for unsinged values and bitmask of sign for singed values,
+    // computed unsigned so that 32 bit samples don't overflow
+    const uint32_t mid  = UINT32_C(1) << (bits_per_sample - 1);
+    const uint32_t mask = bits_per_sample < 32 ? ~UINT32_C(0) << bits_per_sample : 0;
+
+    for (size_t frame = 0; frame < count; ++ frame)
+    {
+        const uint8_t *bytes = data + frame * block_align;
+
+        for (size_t channel = 0; channel < channels; ++ channel)
+        {
+            // http://www.neurophys.wisc.edu/auditory/riff-format.txt
+            // http://home.roadrunner.com/~jgglatt/tech/wave.htm#POINTS
+            uint32_t x = 0;
+
+            for (size_t byte = 0; byte < bytes_per_sample; ++ byte)
+            {
+                x |= (uint32_t)bytes[channel * bytes_per_sample + byte] << (byte * 8);
+            }
+
+            // shift away padding
+            x >>= shift;
+
+            // 1 to 8 bits are unsigned
+            // 9 and more bits are signed
+            if (bits_per_sample > 8)
+            {
+                if (x & mid) { // negative
+                    x |= mask;
+                }
+            }
+            else
+            {
+                x -= mid;
+            }
+
+            *samples ++ = (int32_t)x;
+        }
+    }
+}
+
 static int abs_volume(const int max_value, const ripcheck_volume_t volume)
 {
     switch (volume.unit)
@@ -131,7 +416,7 @@ int ripcheck_parse_time(const char *str, ripcheck_time_t *timeptr)
     
     endptr = skipws(endptr);
     if (*endptr == '\0' || strcasecmp(endptr, "samp") == 0 ||
-        strcasecmp(endptr, "sample") || strcasecmp(endptr, "samples")) {
+        strcasecmp(endptr, "sample") == 0 || strcasecmp(endptr, "samples") == 0) {
         timeptr->unit = RIPCHECK_SAMP;
     }
     else if (strcasecmp(endptr, "ms") == 0 || strcasecmp(endptr, "msec") == 0 ||
@@ -151,198 +436,232 @@ int ripcheck_parse_time(const char *str, ripcheck_time_t *timeptr)
     return 0;
 }
 
-int ripcheck(
+int ripcheck_open(
     FILE *f,
     const char *filename,
-    ripcheck_time_t max_time,
-    ripcheck_time_t intro_length,
-    ripcheck_time_t outro_length,
-    ripcheck_time_t pop_drop_dist,
-    ripcheck_time_t dupe_dist,
-    ripcheck_volume_t pop_limit,
-    ripcheck_volume_t drop_limit,
-    ripcheck_volume_t dupe_limit,
-    size_t min_dupes,
-    size_t max_bad_areas,
-    size_t window_size,
+    const struct ripcheck_options *options,
+    struct ripcheck_context   *context,
     struct ripcheck_callbacks *callbacks)
 {
-    struct ripcheck_context context;
-
-    memset(&context, 0, sizeof(context));
-
-    context.filename  = filename;
-    context.min_dupes = min_dupes;
-    context.max_bad_areas = max_bad_areas;
+    memset(context, 0, sizeof(*context));
+
+    context->filename  = filename;
+    context->min_dupes = options->min_dupes;
+    context->min_clipped = options->min_clipped;
+    context->max_bad_areas = options->max_bad_areas;
+    context->direct_io = options->direct_io;
+    context->checksums = options->checksums;
+    context->peaks     = options->peaks;
+    context->stats     = options->stats;
+    context->spectrum  = options->spectrum;
+    context->time_budget = options->time_budget;
+    context->detectors = options->detectors ? options->detectors : RIPCHECK_DETECTORS_DEFAULT;
+    context->merge_channels = options->merge_channels;
+    context->adaptive_limits = options->adaptive_limits;
+    context->pop_volume  = options->pop_limit;
+    context->drop_volume = options->drop_limit;
+    context->dupe_volume = options->dupe_limit;
+    context->tracks    = options->tracks;
+    context->track_count = options->track_count;
 
     // read RIFF file header and chunk id & size of first chunk in one go:
-    if (fread(&context.riff_header, RIFF_HEADER_SIZE, 1, f) != 1)
+    if (fread(&context->riff_header, RIFF_HEADER_SIZE, 1, f) != 1)
     {
-        int errnum = errno;
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
-        return errnum;
+        return ripcheck_read_error(f, context, callbacks);
     }
 
     // check chunk id of file and first chunk and format of RIFF file
-    if (memcmp(context.riff_header.id, "RIFF", 4) != 0) {
-        callbacks->error(callbacks->data, &context, EINVAL, "Not a 'RIFF' file: '%c%c%c%c'",
-            context.riff_header.id[0],
-            context.riff_header.id[1],
-            context.riff_header.id[2],
-            context.riff_header.id[3]);
+    if (memcmp(context->riff_header.id, "RIFF", 4) != 0) {
+        callbacks->error(callbacks->data, context, EINVAL, "Not a 'RIFF' file: '%c%c%c%c'",
+            context->riff_header.id[0],
+            context->riff_header.id[1],
+            context->riff_header.id[2],
+            context->riff_header.id[3]);
         return EINVAL;
     }
 
-    if (memcmp(context.riff_header.format, "WAVE", 4) != 0) {
-        callbacks->error(callbacks->data, &context, EINVAL, "Not a 'WAVE' format: '%c%c%c%c'",
-            context.riff_header.format[0],
-            context.riff_header.format[1],
-            context.riff_header.format[2],
-            context.riff_header.format[3]);
+    if (memcmp(context->riff_header.format, "WAVE", 4) != 0) {
+        callbacks->error(callbacks->data, context, EINVAL, "Not a 'WAVE' format: '%c%c%c%c'",
+            context->riff_header.format[0],
+            context->riff_header.format[1],
+            context->riff_header.format[2],
+            context->riff_header.format[3]);
         return EINVAL;
     }
 
-    if (memcmp(context.riff_header.chunk.id, "fmt ", 4) != 0) {
-        callbacks->error(callbacks->data, &context, EINVAL, "WAVE file does not start with a 'fmt ' chunk: '%c%c%c%c'",
-            context.riff_header.chunk.id[0],
-            context.riff_header.chunk.id[1],
-            context.riff_header.chunk.id[2],
-            context.riff_header.chunk.id[3]);
+    if (memcmp(context->riff_header.chunk.id, "fmt ", 4) != 0) {
+        callbacks->error(callbacks->data, context, EINVAL, "WAVE file does not start with a 'fmt ' chunk: '%c%c%c%c'",
+            context->riff_header.chunk.id[0],
+            context->riff_header.chunk.id[1],
+            context->riff_header.chunk.id[2],
+            context->riff_header.chunk.id[3]);
         return EINVAL;
     }
 
-    const uint32_t riff_size = le32toh(context.riff_header.size);
-    const uint32_t fmt_size  = le32toh(context.riff_header.chunk.size);
+    const uint32_t riff_size = le32toh(context->riff_header.size);
+    const uint32_t fmt_size  = le32toh(context->riff_header.chunk.size);
     uint32_t pos = fmt_size + 8;
 
     // sanity check of declared sizes
     if (riff_size < pos || fmt_size < WAVE_FMT_SIZE)
     {
-        callbacks->error(callbacks->data, &context, EINVAL,
+        callbacks->error(callbacks->data, context, EINVAL,
             "WAVE file has illegal chunk sizes. RIFF size: %u, fmt size: %u",
             riff_size, fmt_size);
         return EINVAL;
     }
 
     // ignore bytes in fmt chunk after the standard number of bytes
-    if (fread(&context.fmt, WAVE_FMT_SIZE, 1, f) != 1 ||
-        (fmt_size > WAVE_FMT_SIZE && fseek(f, fmt_size - WAVE_FMT_SIZE, SEEK_CUR) != 0))
+    if (fread(&context->fmt, WAVE_FMT_SIZE, 1, f) != 1)
+    {
+        return ripcheck_read_error(f, context, callbacks);
+    }
+    else if (fmt_size > WAVE_FMT_SIZE && fseek(f, fmt_size - WAVE_FMT_SIZE, SEEK_CUR) != 0)
     {
         int errnum = errno;
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
     // convert endian of fmt chunk
-    context.fmt.audio_format    = le16toh(context.fmt.audio_format);
-    context.fmt.channels        = le16toh(context.fmt.channels);
-    context.fmt.sample_rate     = le32toh(context.fmt.sample_rate);
-    context.fmt.byte_rate       = le32toh(context.fmt.byte_rate);
-    context.fmt.block_align     = le16toh(context.fmt.block_align);
-    context.fmt.bits_per_sample = le16toh(context.fmt.bits_per_sample);
-
-    const int max_value = ~(~0u << (context.fmt.bits_per_sample - 1));
-    context.pop_limit  = abs_volume(max_value, pop_limit);
-    context.drop_limit = abs_volume(max_value, drop_limit);
-    context.dupe_limit = abs_volume(max_value, dupe_limit);
-
-    context.max_sample    = time_to_samples(&context, max_time);
-    context.intro_length  = time_to_samples(&context, intro_length);
-    context.outro_length  = time_to_samples(&context, outro_length);
-    context.pop_drop_dist = time_to_samples(&context, pop_drop_dist);
-    context.dupe_dist     = time_to_samples(&context, dupe_dist);
-
-    callbacks->begin(callbacks->data, &context);
-
-    if (context.fmt.audio_format != PCM)
+    context->fmt.audio_format    = le16toh(context->fmt.audio_format);
+    context->fmt.channels        = le16toh(context->fmt.channels);
+    context->fmt.sample_rate     = le32toh(context->fmt.sample_rate);
+    context->fmt.byte_rate       = le32toh(context->fmt.byte_rate);
+    context->fmt.block_align     = le16toh(context->fmt.block_align);
+    context->fmt.bits_per_sample = le16toh(context->fmt.bits_per_sample);
+
+    const int max_value = ~(~0u << (context->fmt.bits_per_sample - 1));
+    context->pop_limit  = abs_volume(max_value, options->pop_limit);
+    context->drop_limit = abs_volume(max_value, options->drop_limit);
+    context->dupe_limit = abs_volume(max_value, options->dupe_limit);
+    context->clip_limit = abs_volume(max_value, options->clip_limit);
+    context->silence_limit = abs_volume(max_value, options->silence_limit);
+    context->loudness_floor = abs_volume(max_value, options->loudness_floor);
+    context->click_limit = abs_volume(max_value, options->click_limit);
+    context->click_ratio = options->click_ratio;
+
+    context->max_sample    = time_to_samples(context, options->max_time);
+    context->start_sample  = time_to_samples(context, options->start_time);
+    context->intro_length  = time_to_samples(context, options->intro_length);
+    context->outro_length  = time_to_samples(context, options->outro_length);
+    context->pop_drop_dist = time_to_samples(context, options->pop_drop_dist);
+    context->dupe_dist     = time_to_samples(context, options->dupe_dist);
+    context->min_dropout   = time_to_samples(context, options->min_dropout);
+    context->merge_dist    = time_to_samples(context, options->merge_dist);
+    context->max_offset    = time_to_samples(context, options->max_offset);
+
+    callbacks->begin(callbacks->data, context);
+
+    if (context->fmt.audio_format != PCM)
     {
-        callbacks->error(callbacks->data, &context, EINVAL, "Not a PCM WAVE file. audio format: %u", context.fmt.audio_format);
+        callbacks->error(callbacks->data, context, EINVAL, "Not a PCM WAVE file. audio format: %u", context->fmt.audio_format);
         return EINVAL;
     }
 
     // sanity checks
-    if (context.fmt.bits_per_sample == 0)
+    if (context->fmt.bits_per_sample == 0)
     {
-        callbacks->error(callbacks->data, &context, EINVAL, "Illegal value of bits per sample: %u", context.fmt.bits_per_sample);
+        callbacks->error(callbacks->data, context, EINVAL, "Illegal value of bits per sample: %u", context->fmt.bits_per_sample);
         return EINVAL;
     }
 
-    const unsigned int ceil_bits_per_sample = to_full_byte(context.fmt.bits_per_sample * context.fmt.channels);
-    if (ceil_bits_per_sample > 8 * context.fmt.block_align)
+    const unsigned int ceil_bits_per_sample = to_full_byte(context->fmt.bits_per_sample * context->fmt.channels);
+    if (ceil_bits_per_sample > 8 * context->fmt.block_align)
     {
-        callbacks->error(callbacks->data, &context, EINVAL, "WAVE file specifies more bits per sample than fit into one sample. "
-            "bits per sample: %u, block alignment: %u", context.fmt.bits_per_sample, context.fmt.block_align);
+        callbacks->error(callbacks->data, context, EINVAL, "WAVE file specifies more bits per sample than fit into one sample. "
+            "bits per sample: %u, block alignment: %u", context->fmt.bits_per_sample, context->fmt.block_align);
         return EINVAL;
     }
     
-    if (ceil_bits_per_sample > 8 * sizeof(int) * context.fmt.channels)
+    if (ceil_bits_per_sample > 8 * sizeof(int) * context->fmt.channels)
     {
-        callbacks->error(callbacks->data, &context, EINVAL, "Too many bits per sample: %u", context.fmt.bits_per_sample);
+        callbacks->error(callbacks->data, context, EINVAL, "Too many bits per sample: %u", context->fmt.bits_per_sample);
         return EINVAL;
     }
 
     // allocate buffers
-    context.frame = malloc(context.fmt.block_align);
+    context->window_size = options->window_size < RIPCHECK_MIN_WINDOW_SIZE ?
+        RIPCHECK_MIN_WINDOW_SIZE : options->window_size;
+    context->window = malloc(sizeof(int) * context->fmt.channels * context->window_size);
 
-    if (!context.frame)
+    if (!context->window)
     {
         int errnum = errno;
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        ripcheck_context_cleanup(context);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
-    context.window_size = window_size < RIPCHECK_MIN_WINDOW_SIZE ? RIPCHECK_MIN_WINDOW_SIZE : window_size;
-    context.window = malloc(sizeof(int) * context.fmt.channels * context.window_size);
+    context->dupecounts = malloc(sizeof(size_t) * context->fmt.channels);
 
-    if (!context.window)
+    if (!context->dupecounts)
     {
         int errnum = errno;
-        ripcheck_context_cleanup(&context);
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        ripcheck_context_cleanup(context);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
-    context.dupecounts = malloc(sizeof(size_t) * context.fmt.channels);
+    context->poplocs = malloc(sizeof(size_t) * context->fmt.channels);
 
-    if (!context.dupecounts)
+    if (!context->poplocs)
     {
         int errnum = errno;
-        ripcheck_context_cleanup(&context);
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        ripcheck_context_cleanup(context);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
-    context.poplocs = malloc(sizeof(size_t) * context.fmt.channels);
+    context->dupelocs = malloc(sizeof(size_t) * context->fmt.channels);
 
-    if (!context.poplocs)
+    if (!context->dupelocs)
     {
         int errnum = errno;
-        ripcheck_context_cleanup(&context);
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        ripcheck_context_cleanup(context);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
-    context.dupelocs = malloc(sizeof(size_t) * context.fmt.channels);
+    context->pop_limits = malloc(sizeof(int) * context->fmt.channels * 3);
 
-    if (!context.dupelocs)
+    if (!context->pop_limits)
     {
         int errnum = errno;
-        ripcheck_context_cleanup(&context);
-        callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+        ripcheck_context_cleanup(context);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
         return errnum;
     }
 
-    // read blocks
+    context->drop_limits = context->pop_limits  + context->fmt.channels;
+    context->dupe_limits = context->drop_limits + context->fmt.channels;
+
+    for (size_t channel = 0; channel < context->fmt.channels; ++ channel)
+    {
+        context->pop_limits[channel]  = context->pop_limit;
+        context->drop_limits[channel] = context->drop_limit;
+        context->dupe_limits[channel] = context->dupe_limit;
+    }
+
+    return 0;
+}
+
+int ripcheck_find_data(
+    FILE *f,
+    const struct ripcheck_context *context,
+    struct ripcheck_callbacks *callbacks,
+    uint32_t *size)
+{
+    const uint32_t riff_size = le32toh(context->riff_header.size);
+    uint32_t pos = le32toh(context->riff_header.chunk.size) + 8;
+
     while (pos < riff_size)
     {
         struct riff_chunk_header chunk_header;
 
         if (fread(&chunk_header, RIFF_CHUNK_HEADER_SIZE, 1, f) != 1)
         {
-            int errnum = errno;
-            ripcheck_context_cleanup(&context);
-            callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
-            return errnum;
+            return ripcheck_read_error(f, context, callbacks);
         }
 
         uint32_t chunk_size = le32toh(chunk_header.size);
@@ -350,212 +669,1003 @@ int ripcheck(
         // TODO: support wave list and silent chunks?
         // http://www.sonicspot.com/guide/wavefiles.html#wavl
 
-        // process data chunk
+        // there may be only one data chunk in a wave file, so stop there
         if (memcmp(chunk_header.id, "data", 4) == 0)
         {
-            int errnum = ripcheck_data(f, chunk_size, &context, callbacks);
-            if (errnum != 0)
-            {
-                ripcheck_context_cleanup(&context);
-                return errnum;
-            }
-
-            // there may be only one data chunk in a wave file, so stop here
-            break;
+            *size = chunk_size;
+            return 0;
         }
         // ignore any other chunk
         else if (fseek(f, chunk_size, SEEK_CUR) != 0)
         {
             int errnum = errno;
-            ripcheck_context_cleanup(&context);
-            callbacks->error(callbacks->data, &context, errnum, "%s", strerror(errnum));
+            callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
             return errnum;
         }
 
         pos += RIFF_CHUNK_HEADER_SIZE + chunk_size;
     }
 
-    ripcheck_context_cleanup(&context);
-    callbacks->complete(callbacks->data, &context);
-
-    return 0;
+    return ENOENT;
 }
 
-int ripcheck_data(
+int ripcheck(
     FILE *f,
-    uint32_t size,
-    struct ripcheck_context   *context,
+    const char *filename,
+    const struct ripcheck_options *options,
     struct ripcheck_callbacks *callbacks)
 {
-    uint8_t *frame      = context->frame;
-    int     *window     = context->window;
-    size_t  *dupecounts = context->dupecounts;
-    size_t  *poplocs    = context->poplocs;
-    size_t  *dupelocs   = context->dupelocs;
-
-    const uint16_t channels        = context->fmt.channels;
-    const uint16_t block_align     = context->fmt.block_align;
-    const uint16_t bits_per_sample = context->fmt.bits_per_sample;
+    struct ripcheck_context context;
+    uint32_t data_size = 0;
 
-    const size_t   max_bad_areas = context->max_bad_areas;
-    const size_t   blocks     = size / block_align;
-    const size_t   max_sample = context->max_sample < blocks ? context->max_sample : blocks;
-    const unsigned int ceil_bits_per_sample = to_full_byte(bits_per_sample);
-    const unsigned int bytes_per_sample     = ceil_bits_per_sample / 8;
-    const unsigned int shift                = ceil_bits_per_sample - bits_per_sample;
+    int errnum = ripcheck_open(f, filename, options, &context, callbacks);
+    if (errnum != 0)
+    {
+        return errnum;
+    }
 
-    // mid is mid-point for unsinged values and bitmask of sign for singed values
-    const int mid  = 1 << (bits_per_sample - 1);
-    const int mask = ~0u << bits_per_sample;
+    // process data chunk, a file without one is reported as empty
+    errnum = ripcheck_find_data(f, &context, callbacks, &data_size);
+    if (errnum == 0)
+    {
+        errnum = ripcheck_data(f, data_size, &context, callbacks);
+    }
+    else if (errnum == ENOENT)
+    {
+        errnum = 0;
+    }
 
-    const int pop_limit  = context->pop_limit;
-    const int drop_limit = context->drop_limit;
-    const int dupe_limit = context->dupe_limit;
+    if (errnum != 0)
+    {
+        ripcheck_context_cleanup(&context);
+        return errnum;
+    }
 
-    const size_t sample_after_intro  = blocks > context->intro_length ? context->intro_length          : blocks;
-    const size_t sample_before_outro = blocks > context->outro_length ? blocks - context->outro_length : 0;
-    const size_t pop_drop_dist       = context->pop_drop_dist;
-    const size_t dupe_dist           = context->dupe_dist;
-    const size_t min_dupes           = context->min_dupes;
-    const size_t window_size         = context->window_size;
-    const size_t window_ints         = window_size * channels;
+    callbacks->complete(callbacks->data, &context);
+    ripcheck_context_cleanup(&context);
 
-    memset(window,     0, sizeof(int)    * window_ints);
-    memset(dupecounts, 0, sizeof(size_t) * channels);
-    memset(poplocs,    0, sizeof(size_t) * channels);
-    memset(dupelocs,   0, sizeof(size_t) * channels);
+    return 0;
+}
 
-    callbacks->sample_data(callbacks->data, context, size);
+// Fold the events after event that are the same problem in other channels
+// into it and return the mask of all channels it was found in. Events are
+// the same problem if both the frames they were found at and their first
+// samples are at most merge_dist apart. Only events reported in the same
+// call are merged, so a problem at a block boundary may still be reported
+// once per channel.
+static uint64_t ripcheck_merge_event(
+    struct ripcheck_events *events,
+    size_t index,
+    struct ripcheck_context *context)
+{
+    const struct ripcheck_event *event = &events->events[index];
+    const size_t dist = context->merge_dist;
+    uint64_t mask = (uint64_t)1 << event->channel;
 
-    if (blocks * block_align < size)
+    for (size_t next = index + 1; next < events->count &&
+         events->events[next].sample - event->sample <= dist; ++ next)
     {
-        // huh, the size of the data chunk in bytes is not a multiple of the blocks
-        callbacks->warning(callbacks->data, context,
-            "The size of the 'data' chunk (%u) is not a multiple of the block alignment (%u).",
-            size, block_align);
-    }
+        struct ripcheck_event *other = &events->events[next];
+        const uint64_t bit = (uint64_t)1 << other->channel;
 
-    // sample indices in window
-    size_t i0 = 0;
-    size_t i1 = 0;
-    size_t i2 = 0;
-    size_t i3 = 0;
-    size_t i4 = 0;
-    size_t i5 = 0;
-    size_t i6 = 0;
+        if (other->type != event->type || other->channel >= 64 || (mask & bit) ||
+            (other->first_sample > event->first_sample ?
+                other->first_sample - event->first_sample :
+                event->first_sample - other->first_sample) > dist)
+        {
+            continue;
+        }
 
-    for (size_t sample = 0; sample < max_sample; ++ sample)
-    {
-        if (fread(frame, block_align, 1, f) != 1)
+        // keep the per channel state as if it was reported on its own
+        switch (other->type)
         {
-            int errnum = errno;
-            callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
-            return errnum;
+            case RIPCHECK_EVENT_POP:
+                context->poplocs[other->channel] = other->first_sample;
+                break;
+
+            case RIPCHECK_EVENT_DUPES:
+                context->dupelocs[other->channel]   = other->first_sample;
+                context->dupecounts[other->channel] = other->last_sample - other->first_sample + 1;
+                break;
         }
 
-        // decode samples into first row of window
-        for (size_t channel = 0; channel < channels; ++ channel)
+        mask |= bit;
+        other->type = RIPCHECK_EVENT_MERGED;
+    }
+
+    return mask;
+}
+
+// Report the events found by the detectors in order. samples points to the
+// decoded frame block_first and the window_size - 1 frames before it are
+// valid. Returns 1 if max_bad_areas is reached.
+// whether a pop or drop was found at the same sample and channel as the event
+static int ripcheck_event_at_pop(const struct ripcheck_events *events, size_t index)
+{
+    const struct ripcheck_event *event = &events->events[index];
+
+    while (index > 0 && events->events[index - 1].sample == event->sample)
+    {
+        const struct ripcheck_event *other = &events->events[-- index];
+
+        if (other->channel == event->channel &&
+            (other->type == RIPCHECK_EVENT_POP || other->type == RIPCHECK_EVENT_DROP))
         {
-            // http://www.neurophys.wisc.edu/auditory/riff-format.txt
-            // http://home.roadrunner.com/~jgglatt/tech/wave.htm#POINTS
-            int x0 = 0;
-            int x1 = window[i1 + channel];
-            int x2 = window[i2 + channel];
-            int x3 = window[i3 + channel];
-            int x4 = window[i4 + channel];
-            int x5 = window[i5 + channel];
-            int x6 = window[i6 + channel];
-
-            // I guess that this *might* be a performance drain:
-            for (size_t byte = 0; byte < bytes_per_sample; ++ byte)
-            {
-                x0 = (frame[channel + byte] << (byte * 8)) | x0;
-            }
+            return 1;
+        }
+    }
 
-            // shift away padding
-            x0 >>= shift;
+    return 0;
+}
 
-            // 1 to 8 bits are unsigned
-            // 9 and more bits are signed
-            if (bits_per_sample > 8)
-            {
-                if (x0 & mid) { // negative
-                    window[i0 + channel] = x0 = x0 | mask;
-                }
-                else { // positive
-                    window[i0 + channel] = x0;
-                }
-            }
-            else
-            {
-                window[i0 + channel] = x0 = x0 - mid;
-            }
+static int ripcheck_report_events(
+    struct ripcheck_events *events,
+    const int *samples,
+    size_t block_first,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    const size_t channels    = context->fmt.channels;
+    const size_t window_ints = context->window_size * channels;
+    // the frame an event was found at is the last one in the window
+    const size_t window_offset = window_ints - channels;
+    const uint64_t all_channels = channels >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << channels) - 1;
+    int stop = 0;
 
-            // analyze audio per channel
+    ripcheck_events_sort(events);
 
-            // look for a pop
-            // (x2 ... x6) == 0, abs(x1) > pop_limit
-            size_t poploc = sample - 2;
-            if (x6 == 0 && x5 == 0 && x4 == 0 && x3 == 0 && (x2 > pop_limit || x2 < -pop_limit) &&
-                sample > 4 && poploc <= sample_before_outro)
-            {
-                ++ context->bad_areas;
-                poplocs[channel] = poploc;
-                callbacks->possible_pop(callbacks->data, context, i0, channel, sample);
-                if (context->bad_areas >= max_bad_areas) break;
-            }
-            else
-            {
-                poploc = poplocs[channel];
-            }
+    for (size_t index = 0; index < events->count && !stop; ++ index)
+    {
+        const struct ripcheck_event *event = &events->events[index];
+        const uint16_t channel = event->channel;
 
-            // look for a dropped sample, but not closer than pop_drop_dist samples to the previous pop
-            // x2 > drop_limit, x1 == 0, x0 > drop_limit
-            // x2 < drop_limit, x1 == 0, x0 < drop_limit
-            size_t droploc = sample - 1;
-            if (x1 == 0 &&
-                ((x2 > drop_limit && x0 > drop_limit) || (x2 < -drop_limit && x0 < -drop_limit)) &&
-                droploc > poploc + pop_drop_dist &&
-                droploc >= sample_after_intro &&
-                droploc <= sample_before_outro)
-            {
-                ++ context->bad_areas;
-                callbacks->possible_drop(callbacks->data, context, i0, channel, sample, droploc);
-                if (context->bad_areas >= max_bad_areas) break;
-            }
+        if (event->type == RIPCHECK_EVENT_MERGED)
+        {
+            continue;
+        }
 
-            // look for duplicates
-            if (x0 == x1) {
-                ++ dupecounts[channel];
-            }
-            else {
-                size_t dupeloc = sample - dupecounts[channel];
-                if ((x1 <= -dupe_limit || x1 >= dupe_limit) &&
-                    dupecounts[channel] >= min_dupes &&
-                    dupeloc <= sample_before_outro &&
-                    dupeloc >= sample_after_intro &&
-                    dupeloc > dupelocs[channel] + dupe_dist)
-                {
-                    ++ context->bad_areas;
-                    dupelocs[channel] = dupeloc;
-                    callbacks->dupes(callbacks->data, context, i0, channel, sample);
-                    if (context->bad_areas >= max_bad_areas) break;
-                }
-                dupecounts[channel] = 0;
-            }
+        // a drop shortly after a pop is part of the pop
+        if (event->type == RIPCHECK_EVENT_DROP &&
+            event->first_sample <= context->poplocs[channel] + context->pop_drop_dist)
+        {
+            continue;
         }
 
-        // shift the window
-        i6 = i5;
-        i5 = i4;
-        i4 = i3;
-        i3 = i2;
-        i2 = i1;
-        i1 = i0;
-        i0 = (i0 + channels) % window_ints;
-    }
+        // a click at a pop or drop is the same spike, which sorts before it
+        if (event->type == RIPCHECK_EVENT_CLICK && ripcheck_event_at_pop(events, index))
+        {
+            continue;
+        }
 
-    return 0;
+        if (event->type == RIPCHECK_EVENT_DROPOUT)
+        {
+            context->channel_mask = all_channels;
+        }
+        else if (context->merge_channels && channel < 64)
+        {
+            context->channel_mask = ripcheck_merge_event(events, index, context);
+        }
+        else
+        {
+            context->channel_mask = channel < 64 ? (uint64_t)1 << channel : 0;
+        }
+
+        memcpy(context->window, samples + (event->sample - block_first + 1) * channels - window_ints,
+            sizeof(int) * window_ints);
+
+        ++ context->bad_areas;
+
+        switch (event->type)
+        {
+            case RIPCHECK_EVENT_POP:
+                context->poplocs[channel] = event->first_sample;
+                callbacks->possible_pop(callbacks->data, context, window_offset, channel, event->sample);
+                break;
+
+            case RIPCHECK_EVENT_DROP:
+                callbacks->possible_drop(callbacks->data, context, window_offset, channel,
+                    event->sample, event->first_sample);
+                break;
+
+            case RIPCHECK_EVENT_DUPES:
+                context->dupelocs[channel]   = event->first_sample;
+                context->dupecounts[channel] = event->last_sample - event->first_sample + 1;
+                callbacks->dupes(callbacks->data, context, window_offset, channel, event->sample);
+                break;
+
+            case RIPCHECK_EVENT_CLIPPING:
+                callbacks->clipping(callbacks->data, context, window_offset, channel,
+                    event->sample, event->first_sample, event->last_sample);
+                break;
+
+            case RIPCHECK_EVENT_DROPOUT:
+                callbacks->dropout(callbacks->data, context, window_offset, channel,
+                    event->sample, event->first_sample, event->last_sample);
+                break;
+
+            case RIPCHECK_EVENT_CLICK:
+                callbacks->click(callbacks->data, context, window_offset, channel,
+                    event->sample, event->first_sample, event->last_sample);
+                break;
+        }
+
+        stop = context->bad_areas >= context->max_bad_areas;
+    }
+
+    events->count = 0;
+
+    return stop;
+}
+
+// Time constant of the running loudness in milliseconds.
+#define LOUDNESS_TIME_CONSTANT 500
+
+// Update the running mean square of each channel with count decoded frames
+// and derive the limits from it. The loudness is the amplitude of a sine with
+// the same RMS, so a full scale sine has a loudness of max_value. It is an
+// exponential integrator over whole blocks, the first block sets it directly.
+static void ripcheck_adapt_limits(
+    struct ripcheck_context *context,
+    const int *samples,
+    size_t count,
+    double *mean_squares,
+    int first_block)
+{
+    const size_t channels  = context->fmt.channels;
+    const int    max_value = ~(~0u << (context->fmt.bits_per_sample - 1));
+    const double tau       = (double)context->fmt.sample_rate * LOUDNESS_TIME_CONSTANT / 1000;
+    const double weight    = first_block ? 1.0 : count / (count + tau);
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (size_t channel = 0; channel < channels; ++ channel)
+    {
+        const int *x = samples + channel;
+        double sum = 0;
+
+        // squares of up to 24 bit samples of a block can't overflow 64 bits
+        if (context->fmt.bits_per_sample <= 24)
+        {
+            uint64_t squares = 0;
+
+            for (size_t frame = 0; frame < count; ++ frame, x += channels)
+            {
+                squares += (uint64_t)((int64_t)*x * *x);
+            }
+
+            sum = (double)squares;
+        }
+        else
+        {
+            for (size_t frame = 0; frame < count; ++ frame, x += channels)
+            {
+                sum += (double)*x * *x;
+            }
+        }
+
+        mean_squares[channel] += (sum / count - mean_squares[channel]) * weight;
+
+        int64_t loudness = ripcheck_isqrt((uint64_t)(2 * mean_squares[channel]));
+        if (loudness < context->loudness_floor) loudness = context->loudness_floor;
+        if (loudness > max_value)               loudness = max_value;
+
+        context->pop_limits[channel]  = abs_volume((int)loudness, context->pop_volume);
+        context->drop_limits[channel] = abs_volume((int)loudness, context->drop_volume);
+        context->dupe_limits[channel] = abs_volume((int)loudness, context->dupe_volume);
+    }
+}
+
+// frames that are decoded at a time for the sinks if the analysis didn't
+#define SINKS_DECODE_FRAMES 4096
+
+// Everything that is computed over the whole data chunk in the same pass as
+// the analysis. Members that were not requested are NULL. Peaks and stats
+// get the samples decoded for the analysis, decoded only holds the samples
+// of data that isn't analyzed.
+struct data_sinks
+{
+    struct ripcheck_checksum_state *checksum_state;
+    struct ripcheck_peaks    *peaks;
+    struct ripcheck_stats    *stats;
+    struct ripcheck_spectrum *spectrum;
+    int *decoded;
+};
+
+static void data_sinks_cleanup(struct data_sinks *sinks)
+{
+    free(sinks->decoded);
+    sinks->decoded = NULL;
+
+    if (sinks->peaks)
+    {
+        ripcheck_peaks_cleanup(sinks->peaks);
+        free(sinks->peaks);
+        sinks->peaks = NULL;
+    }
+
+    if (sinks->stats)
+    {
+        ripcheck_stats_cleanup(sinks->stats);
+        free(sinks->stats);
+        sinks->stats = NULL;
+    }
+
+    if (sinks->spectrum)
+    {
+        ripcheck_spectrum_cleanup(sinks->spectrum);
+        free(sinks->spectrum);
+        sinks->spectrum = NULL;
+    }
+}
+
+// checksum_state is used if the checksums were requested
+static int data_sinks_init(
+    struct data_sinks *sinks,
+    struct ripcheck_checksum_state *checksum_state,
+    size_t blocks,
+    const struct ripcheck_context *context)
+{
+    int errnum = 0;
+
+    memset(sinks, 0, sizeof(*sinks));
+
+    if (context->checksums)
+    {
+        ripcheck_checksum_init(checksum_state, &context->fmt);
+        sinks->checksum_state = checksum_state;
+    }
+
+    if (context->peaks && (!(sinks->peaks = malloc(sizeof(struct ripcheck_peaks))) ||
+        (errnum = ripcheck_peaks_init(sinks->peaks, &context->fmt, blocks)) != 0))
+    {
+        errnum = errnum ? errnum : errno;
+        free(sinks->peaks);
+        sinks->peaks = NULL;
+    }
+
+    if (errnum == 0 && context->stats && (!(sinks->stats = malloc(sizeof(struct ripcheck_stats))) ||
+        (errnum = ripcheck_stats_init(sinks->stats, &context->fmt)) != 0))
+    {
+        errnum = errnum ? errnum : errno;
+        free(sinks->stats);
+        sinks->stats = NULL;
+    }
+
+    if (errnum == 0 && context->spectrum && (!(sinks->spectrum = malloc(sizeof(struct ripcheck_spectrum))) ||
+        (errnum = ripcheck_spectrum_init(sinks->spectrum, context)) != 0))
+    {
+        errnum = errnum ? errnum : errno;
+        free(sinks->spectrum);
+        sinks->spectrum = NULL;
+    }
+
+    if (errnum == 0 && (sinks->peaks || sinks->stats) &&
+        !(sinks->decoded = malloc(sizeof(int) * context->fmt.channels * SINKS_DECODE_FRAMES)))
+    {
+        errnum = errno;
+    }
+
+    if (errnum != 0)
+    {
+        data_sinks_cleanup(sinks);
+    }
+
+    return errnum;
+}
+
+static int data_sinks_any(const struct data_sinks *sinks)
+{
+    return sinks->checksum_state || sinks->peaks || sinks->stats || sinks->spectrum;
+}
+
+// whether the sinks need every sample of a block decoded
+static int data_sinks_decode(const struct data_sinks *sinks)
+{
+    return sinks && (sinks->peaks || sinks->stats);
+}
+
+// Feed a block to the sinks. samples are its frames as decoded by
+// ripcheck_decode(), or NULL if they have to be decoded here.
+static void data_sinks_update(
+    const struct data_sinks *sinks,
+    const struct ripcheck_context *context,
+    const uint8_t *block,
+    size_t block_length,
+    const int *samples)
+{
+    const size_t block_align = context->fmt.block_align;
+    const size_t frames      = block_length / block_align;
+
+    if (sinks->checksum_state)
+    {
+        ripcheck_checksum_update(sinks->checksum_state, block, block_length);
+    }
+
+    for (size_t frame = 0; frame < frames && data_sinks_decode(sinks);)
+    {
+        size_t count = frames - frame;
+
+        if (!samples)
+        {
+            if (count > SINKS_DECODE_FRAMES) count = SINKS_DECODE_FRAMES;
+            ripcheck_decode(context, block + frame * block_align, count, sinks->decoded);
+        }
+
+        const int *decoded = samples ? samples : sinks->decoded;
+
+        if (sinks->peaks)
+        {
+            ripcheck_peaks_update(sinks->peaks, decoded, count);
+        }
+
+        if (sinks->stats)
+        {
+            ripcheck_stats_update(sinks->stats, decoded, count);
+        }
+
+        frame += count;
+    }
+
+    if (sinks->spectrum)
+    {
+        ripcheck_spectrum_update(sinks->spectrum, context, block, block_length);
+    }
+}
+
+// hand the results over to the context
+static void data_sinks_final(struct data_sinks *sinks, struct ripcheck_context *context)
+{
+    if (sinks->checksum_state)
+    {
+        ripcheck_checksum_final(sinks->checksum_state, &context->digests);
+    }
+
+    if (sinks->peaks)
+    {
+        ripcheck_peaks_final(sinks->peaks);
+        context->pyramid = sinks->peaks;
+        sinks->peaks = NULL;
+    }
+
+    context->channel_stats = sinks->stats;
+    sinks->stats = NULL;
+
+    if (sinks->spectrum)
+    {
+        ripcheck_spectrum_final(sinks->spectrum);
+        context->average_spectrum = sinks->spectrum;
+        sinks->spectrum = NULL;
+    }
+}
+
+// Analyze the samples first to end - 1 read by reader, which has to start at
+// sample first. Events found before sample report_from are not reported, so
+// the samples in between can warm up the window and run counters. Each block
+// is decoded once and then every enabled detector runs over it. Every block
+// that is read is also fed to sinks unless it is NULL. Returns an errno value
+// or RIPCHECK_DATA_EOF as returned by data_reader_next().
+static int ripcheck_analyze(
+    struct data_reader *reader,
+    size_t blocks,
+    size_t first,
+    size_t end,
+    size_t report_from,
+    const struct data_sinks *sinks,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    const uint16_t channels        = context->fmt.channels;
+    const uint16_t block_align     = context->fmt.block_align;
+    const uint16_t bits_per_sample = context->fmt.bits_per_sample;
+
+    // intro and outro are applied per track if the file is a disc image
+    size_t sample_after_intro  = blocks > context->intro_length ? context->intro_length          : blocks;
+    size_t sample_before_outro = blocks > context->outro_length ? blocks - context->outro_length : 0;
+    size_t next_track_start    = SIZE_MAX;
+    size_t track_index         = 0;
+    // pops are only excluded from the intro at track boundaries, not at the start of the file
+    size_t pop_after           = 0;
+    const size_t window_size   = context->window_size;
+    const size_t window_ints   = window_size * channels;
+
+    if (context->track_count > 0)
+    {
+        ripcheck_enter_track(context, blocks, track_index,
+            &sample_after_intro, &sample_before_outro, &next_track_start);
+    }
+
+    memset(context->window,     0, sizeof(int)    * window_ints);
+    memset(context->dupecounts, 0, sizeof(size_t) * channels);
+    memset(context->poplocs,    0, sizeof(size_t) * channels);
+    memset(context->dupelocs,   0, sizeof(size_t) * channels);
+
+    const struct ripcheck_detector *detectors[sizeof(unsigned int) * 8];
+    size_t state_offsets[sizeof(unsigned int) * 8];
+    size_t detector_count = 0;
+    size_t state_size     = 0;
+
+    // frames of a block are only skipped if all detectors allow it
+    unsigned int features = 0;
+    // only packed 16 and 24 bit samples are swept
+    const unsigned int sweep_bytes = bits_per_sample / 8;
+    int sweep = (bits_per_sample == 16 || bits_per_sample == 24) && block_align == sweep_bytes * channels;
+
+    for (size_t index = 0; ripcheck_detectors[index]; ++ index)
+    {
+        const struct ripcheck_detector *detector = ripcheck_detectors[index];
+
+        if (context->detectors & (1u << index))
+        {
+            const unsigned int needs = detector->sweep ? detector->sweep(context) : 0;
+            features |= needs;
+            if (needs == 0) sweep = 0;
+
+            detectors[detector_count]     = detector;
+            state_offsets[detector_count] = state_size;
+            state_size += detector->state_size * channels;
+            ++ detector_count;
+        }
+    }
+
+    struct ripcheck_events events = { NULL, 0, 0 };
+    uint8_t *states  = calloc(state_size > 0 ? state_size : 1, 1);
+    // the last window_size frames of the previous block followed by the current block
+    int *decoded     = calloc(window_ints, sizeof(int));
+    size_t capacity  = 0;
+    // running loudness of each channel for adaptive limits
+    double *mean_squares = context->adaptive_limits ? calloc(channels, sizeof(double)) : NULL;
+
+    if (!states || !decoded || (context->adaptive_limits && !mean_squares))
+    {
+        int errnum = errno;
+        free(states);
+        free(decoded);
+        free(mean_squares);
+        return errnum;
+    }
+
+    int errnum = 0;
+    int stop   = 0;
+
+    for (size_t sample = first; sample < end && !stop;)
+    {
+        const uint8_t *block = NULL;
+        size_t block_length  = 0;
+
+        // a truncated frame at the end of the data is dropped
+        do {
+            errnum = data_reader_next(reader, &block, &block_length);
+
+            if (sinks && block_length > 0 && block_length < block_align)
+            {
+                data_sinks_update(sinks, context, block, block_length, NULL);
+            }
+        } while (errnum == 0 && block_length > 0 && block_length < block_align);
+
+        if (errnum != 0 || block_length == 0)
+        {
+            break;
+        }
+
+        size_t frames = block_length / block_align;
+        if (frames > end - sample) frames = end - sample;
+
+        if (frames > capacity)
+        {
+            int *buf = realloc(decoded, sizeof(int) * (window_ints + frames * channels));
+
+            if (!buf)
+            {
+                errnum = errno;
+                break;
+            }
+
+            decoded  = buf;
+            capacity = frames;
+        }
+
+        int *samples = decoded + window_ints;
+        size_t analyzed = frames;
+
+        // An event is found up to 6 frames after the samples it depends on,
+        // so the head is analyzed in full and the frames after it are skipped
+        // if the sweep finds nothing from 6 frames before them on. Only the
+        // last window_size frames are decoded for the next block, unless the
+        // loudness needs all of them.
+        if (sweep && frames > SWEEP_HEAD_FRAMES + window_size &&
+            ripcheck_sweep(block, SWEEP_HEAD_FRAMES - 6, frames, channels, sweep_bytes, features, context->clip_limit))
+        {
+            analyzed = SWEEP_HEAD_FRAMES;
+        }
+
+        // the sinks get the decoded samples of the whole block
+        const int decode_all = mean_squares || (data_sinks_decode(sinks) && frames == block_length / block_align);
+
+        if (analyzed < frames && !decode_all)
+        {
+            ripcheck_decode(context, block, analyzed, samples);
+            ripcheck_decode(context, block + (frames - window_size) * block_align, window_size,
+                samples + (frames - window_size) * channels);
+        }
+        else
+        {
+            ripcheck_decode(context, block, frames, samples);
+        }
+
+        if (sinks)
+        {
+            data_sinks_update(sinks, context, block, block_length,
+                decode_all && frames == block_length / block_align ? samples : NULL);
+        }
+
+        if (mean_squares)
+        {
+            ripcheck_adapt_limits(context, samples, frames, mean_squares, sample == first);
+        }
+
+        // the intro and outro may change at track boundaries within the block
+        for (size_t frame = 0; frame < analyzed && !stop;)
+        {
+            const size_t segment_first = sample + frame;
+
+            while (segment_first >= next_track_start)
+            {
+                ripcheck_enter_track(context, blocks, ++ track_index,
+                    &sample_after_intro, &sample_before_outro, &next_track_start);
+                pop_after = sample_after_intro;
+            }
+
+            const size_t segment_end = next_track_start - sample < analyzed ?
+                next_track_start - sample : analyzed;
+
+            const struct ripcheck_segment segment = {
+                .samples             = samples + frame * channels,
+                .first_sample        = segment_first,
+                .frames              = segment_end - frame,
+                .first_read          = first,
+                .report_from         = report_from,
+                .sample_after_intro  = sample_after_intro,
+                .sample_before_outro = sample_before_outro,
+                .pop_after           = pop_after
+            };
+
+            for (size_t index = 0; index < detector_count && errnum == 0; ++ index)
+            {
+                errnum = detectors[index]->detect(states + state_offsets[index], context, &segment, &events);
+            }
+
+            if (errnum != 0)
+            {
+                stop = 1;
+                break;
+            }
+
+            stop  = ripcheck_report_events(&events, samples, sample, context, callbacks);
+            frame = segment_end;
+        }
+
+        if (analyzed < frames)
+        {
+            for (size_t index = 0; index < detector_count; ++ index)
+            {
+                if (detectors[index]->resync)
+                {
+                    detectors[index]->resync(states + state_offsets[index], context,
+                        samples + frames * channels);
+                }
+            }
+        }
+
+        // keep the last window_size frames for the next block
+        memmove(decoded, decoded + frames * channels, sizeof(int) * window_ints);
+        sample += frames;
+    }
+
+    ripcheck_events_cleanup(&events);
+    free(states);
+    free(decoded);
+    free(mean_squares);
+
+    return errnum;
+}
+
+// report what data_reader_next() returned at the end of the analysis
+static int ripcheck_data_status(
+    int errnum,
+    uint32_t size,
+    const struct ripcheck_context *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    if (errnum == RIPCHECK_DATA_EOF)
+    {
+        callbacks->warning(callbacks->data, context,
+            "The 'data' chunk ends before its declared size (%u bytes).", size);
+    }
+    else if (errnum != 0)
+    {
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    return 0;
+}
+
+static size_t reverse_bits(size_t value, unsigned int bits)
+{
+    size_t reversed = 0;
+
+    for (unsigned int bit = 0; bit < bits; ++ bit)
+    {
+        reversed = (reversed << 1) | ((value >> bit) & 1);
+    }
+
+    return reversed;
+}
+
+static size_t elapsed_msec(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// Seek to the samples first to end - 1 of the data chunk that starts at
+// data_start and analyze them after a short pre-roll.
+static int ripcheck_analyze_range(
+    FILE *f,
+    off_t  data_start,
+    size_t blocks,
+    size_t first,
+    size_t end,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    const uint16_t block_align = context->fmt.block_align;
+    // enough samples before first to find dupes, clipping and dropouts that
+    // start there and for the click detector to learn the level
+    size_t min_run = context->min_dupes;
+    if (min_run < context->min_clipped) min_run = context->min_clipped;
+    if (min_run < context->min_dropout) min_run = context->min_dropout;
+    if (min_run < RIPCHECK_CLICK_WARMUP) min_run = RIPCHECK_CLICK_WARMUP;
+    const size_t   preroll     = context->window_size + min_run;
+    const size_t   start       = first > preroll ? first - preroll : 0;
+
+    if (fseeko(f, data_start + (off_t)start * block_align, SEEK_SET) != 0)
+    {
+        return errno;
+    }
+
+    struct data_reader *reader = NULL;
+    const size_t block_frames = DATA_BLOCK_SIZE / block_align;
+    int errnum = data_reader_open(&reader, f, (uint64_t)(end - start) * block_align,
+        block_frames * block_align, context->direct_io);
+
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    errnum = ripcheck_analyze(reader, blocks, start, end, first, NULL, context, callbacks);
+    data_reader_close(reader);
+
+    return errnum;
+}
+
+// Analyze the samples first_sample to max_sample - 1 in regions of
+// DATA_BLOCK_SIZE until the time budget is used up. The first and the last
+// region are analyzed first, then the regions in between in bit reversed
+// order, which spreads them evenly. The analyzed sample ranges are reported
+// through covered.
+static int ripcheck_data_budget(
+    FILE *f,
+    uint32_t size,
+    size_t first_sample,
+    size_t max_sample,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    const uint16_t block_align   = context->fmt.block_align;
+    const size_t   blocks        = size / block_align;
+    const size_t   region_frames = DATA_BLOCK_SIZE / block_align;
+    const size_t   regions       = (max_sample - first_sample + region_frames - 1) / region_frames;
+    const off_t    data_start    = ftello(f);
+
+    if (data_start < 0)
+    {
+        int errnum = errno;
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    uint8_t *covered = calloc(regions > 0 ? regions : 1, 1);
+
+    if (!covered)
+    {
+        int errnum = errno;
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    // the regions in between are numbered 0 to spread - 1 in bit reversed order
+    size_t spread = 1;
+    unsigned int bits = 0;
+    while (spread + 2 < regions)
+    {
+        spread <<= 1;
+        ++ bits;
+    }
+
+    int errnum = 0;
+    for (size_t index = 0; index < spread + 2 && errnum == 0; ++ index)
+    {
+        size_t region;
+
+        if (index == 0)
+        {
+            region = 0;
+        }
+        else if (index == 1)
+        {
+            region = regions - 1;
+        }
+        else
+        {
+            region = reverse_bits(index - 2, bits) + 1;
+        }
+
+        if (region >= regions || covered[region])
+        {
+            continue;
+        }
+
+        // at least one region is always analyzed
+        if (index > 0 && elapsed_msec(&started) >= context->time_budget)
+        {
+            break;
+        }
+
+        const size_t first = first_sample + region * region_frames;
+        const size_t end   = max_sample - first > region_frames ? first + region_frames : max_sample;
+
+        errnum = ripcheck_analyze_range(f, data_start, blocks, first, end, context, callbacks);
+
+        if (errnum == 0)
+        {
+            covered[region] = 1;
+        }
+
+        if (context->bad_areas >= context->max_bad_areas)
+        {
+            break;
+        }
+    }
+
+    // report adjacent regions as one range
+    for (size_t region = 0; region < regions; ++ region)
+    {
+        if (covered[region])
+        {
+            const size_t first = first_sample + region * region_frames;
+
+            while (region + 1 < regions && covered[region + 1])
+            {
+                ++ region;
+            }
+
+            const size_t last = first_sample + (region + 1) * region_frames;
+            callbacks->covered(callbacks->data, context, first, (last < max_sample ? last : max_sample) - 1);
+        }
+    }
+
+    free(covered);
+
+    return ripcheck_data_status(errnum, size, context, callbacks);
+}
+
+int ripcheck_data(
+    FILE *f,
+    uint32_t size,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks)
+{
+    const uint16_t block_align = context->fmt.block_align;
+    const size_t   blocks      = size / block_align;
+    const size_t   max_sample  = context->max_sample < blocks ? context->max_sample : blocks;
+    const size_t   start_sample = context->start_sample < max_sample ? context->start_sample : max_sample;
+
+    callbacks->sample_data(callbacks->data, context, size);
+
+    if (blocks * block_align < size)
+    {
+        // huh, the size of the data chunk in bytes is not a multiple of the blocks
+        callbacks->warning(callbacks->data, context,
+            "The size of the 'data' chunk (%u) is not a multiple of the block alignment (%u).",
+            size, block_align);
+    }
+
+    if (context->time_budget > 0)
+    {
+        return ripcheck_data_budget(f, size, start_sample, max_sample, context, callbacks);
+    }
+
+    // seek to the start instead of reading through everything before it
+    if (start_sample > 0)
+    {
+        const off_t data_start = ftello(f);
+        int errnum = data_start < 0 ? errno :
+            ripcheck_analyze_range(f, data_start, blocks, start_sample, max_sample, context, callbacks);
+
+        if (errnum == 0 && start_sample < max_sample)
+        {
+            callbacks->covered(callbacks->data, context, start_sample, max_sample - 1);
+        }
+
+        return ripcheck_data_status(errnum, size, context, callbacks);
+    }
+
+    // the checksums, the waveform pyramid, the statistics and the spectrum are
+    // computed in the same pass, but over the whole data chunk
+    struct ripcheck_checksum_state checksum_state;
+    struct data_sinks sinks;
+    int errnum = data_sinks_init(&sinks, &checksum_state, blocks, context);
+
+    if (errnum != 0)
+    {
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    const int whole = data_sinks_any(&sinks);
+
+    // read the data chunk in blocks of whole frames
+    struct data_reader *reader = NULL;
+    const size_t block_frames = DATA_BLOCK_SIZE / block_align;
+    errnum = data_reader_open(&reader, f, whole ? size : (uint64_t)max_sample * block_align,
+        block_frames * block_align, context->direct_io);
+
+    if (errnum != 0)
+    {
+        data_sinks_cleanup(&sinks);
+        callbacks->error(callbacks->data, context, errnum, "%s", strerror(errnum));
+        return errnum;
+    }
+
+    errnum = ripcheck_analyze(reader, blocks, 0, max_sample, 0, &sinks, context, callbacks);
+
+    // feed the data after max_sample to the sinks
+    const uint8_t *block = NULL;
+    size_t block_length  = 0;
+
+    while (whole && errnum == 0)
+    {
+        errnum = data_reader_next(reader, &block, &block_length);
+
+        if (block_length == 0)
+        {
+            break;
+        }
+
+        data_sinks_update(&sinks, context, block, block_length, NULL);
+    }
+
+    data_reader_close(reader);
+
+    if (errnum == 0 || errnum == RIPCHECK_DATA_EOF)
+    {
+        data_sinks_final(&sinks, context);
+    }
+
+    // frees what data_sinks_final() didn't hand over
+    data_sinks_cleanup(&sinks);
+
+    return ripcheck_data_status(errnum, size, context, callbacks);
 }
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
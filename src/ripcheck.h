@@ -25,6 +25,12 @@
 #include <stdint.h>
 #include <inttypes.h>
 
+#include "checksum.h"
+
+struct ripcheck_peaks;
+struct ripcheck_stats;
+struct ripcheck_spectrum;
+
 #if (defined(_WIN16) || defined(_WIN32) || defined(_WIN64)) && !defined(__CYGWIN__)
 #    ifdef _WIN64
 #        define PRIzu PRIu64
@@ -104,9 +110,67 @@ typedef struct ripcheck_time {
     enum ripcheck_time_unit unit;
 } ripcheck_time_t;
 
+// track of a disc image
+struct ripcheck_track {
+    unsigned int number;
+    // start in CD frames (1/75 sec)
+    size_t start;
+};
+
+struct ripcheck_options {
+    ripcheck_time_t   max_time;
+    // seek to this time instead of analyzing from the start
+    ripcheck_time_t   start_time;
+    ripcheck_time_t   intro_length;
+    ripcheck_time_t   outro_length;
+    ripcheck_time_t   pop_drop_dist;
+    ripcheck_time_t   dupe_dist;
+    ripcheck_volume_t pop_limit;
+    ripcheck_volume_t drop_limit;
+    ripcheck_volume_t dupe_limit;
+    ripcheck_volume_t clip_limit;
+    ripcheck_volume_t silence_limit;
+    ripcheck_time_t   min_dropout;
+    size_t min_dupes;
+    size_t min_clipped;
+    size_t max_bad_areas;
+    size_t window_size;
+    // read the data chunk bypassing the page cache
+    int    direct_io;
+    // compute CRC32, MD5 and AccurateRip checksums of the data chunk
+    int    checksums;
+    // apply intro and outro per track of a disc image
+    const struct ripcheck_track *tracks;
+    size_t track_count;
+    // analyze as much as possible in this many milliseconds (0: no limit)
+    size_t time_budget;
+    // build a min/max/RMS waveform pyramid of the data chunk
+    int    peaks;
+    // bitmask of the detectors to run (0: the default ones)
+    unsigned int detectors;
+    // report a problem found in several channels within merge_dist once
+    int    merge_channels;
+    ripcheck_time_t merge_dist;
+    // make ratio pop, drop and dupe limits relative to the running loudness
+    // of each channel, which never counts as lower than loudness_floor
+    int    adaptive_limits;
+    ripcheck_volume_t loudness_floor;
+    // a click sticks out of the running level of its channel by more than
+    // click_ratio and deviates from its neighbours by more than click_limit
+    size_t click_ratio;
+    ripcheck_volume_t click_limit;
+    // how far apart the same audio may be in files that are compared
+    ripcheck_time_t max_offset;
+    // gather peak, RMS, DC offset, zeros, repeats and used bits per channel
+    int    stats;
+    // average the spectrum of each channel to find where its band ends
+    int    spectrum;
+};
+
 struct ripcheck_context {
     const char *filename;
     size_t max_sample;
+    size_t start_sample;
     size_t intro_length;
     size_t outro_length;
     size_t pop_drop_dist;
@@ -114,10 +178,13 @@ struct ripcheck_context {
     int    pop_limit;
     int    drop_limit;
     int    dupe_limit;
+    int    clip_limit;
+    int    silence_limit;
     size_t min_dupes;
+    size_t min_clipped;
+    size_t min_dropout;
     struct riff_header riff_header;
     struct wave_fmt    fmt;
-    uint8_t *frame;
     int     *window;
     size_t   window_size;
     size_t  *dupelocs;
@@ -125,6 +192,47 @@ struct ripcheck_context {
     size_t  *poplocs;
     size_t   bad_areas;
     size_t   max_bad_areas;
+    int      direct_io;
+    int      checksums;
+    // valid when complete is called if checksums was requested
+    struct ripcheck_checksums digests;
+    const struct ripcheck_track *tracks;
+    size_t   track_count;
+    // current track number (0 if there are no tracks) and its first sample
+    unsigned int track;
+    size_t   track_start;
+    size_t   time_budget;
+    int      peaks;
+    // set when complete is called if peaks was requested
+    struct ripcheck_peaks *pyramid;
+    unsigned int detectors;
+    int      merge_channels;
+    size_t   merge_dist;
+    // channels the reported problem was found in (bit n is channel n, only
+    // the first 64 channels are merged), set before each problem callback
+    uint64_t channel_mask;
+    int      adaptive_limits;
+    int      loudness_floor;
+    ripcheck_volume_t pop_volume;
+    ripcheck_volume_t drop_volume;
+    ripcheck_volume_t dupe_volume;
+    // limits of each channel, updated per block if adaptive_limits is set
+    int     *pop_limits;
+    int     *drop_limits;
+    int     *dupe_limits;
+    size_t   click_ratio;
+    int      click_limit;
+    size_t   max_offset;
+    // file the data is compared with and how many frames later the same
+    // audio is found in it (negative if earlier), set by ripcheck_compare()
+    const char *compare_filename;
+    int64_t  compare_offset;
+    int      stats;
+    // set when complete is called if stats was requested
+    struct ripcheck_stats *channel_stats;
+    int      spectrum;
+    // set when complete is called if spectrum was requested
+    struct ripcheck_spectrum *average_spectrum;
 };
 
 int ripcheck_parse_volume(const char *str, ripcheck_volume_t *volume);
@@ -162,10 +270,57 @@ typedef void (*ripcheck_dupes_t)(
     uint16_t     channel,
     size_t       last_window_sample);
 
+// Reports a run of clipped samples from first_sample to last_sample.
+typedef void (*ripcheck_clipping_t)(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+// Reports a stretch from first_sample to last_sample in which all channels
+// are silent. channel is always 0 and channel_mask has all channels set.
+typedef void (*ripcheck_dropout_t)(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+// Reports a single sample at first_sample that sticks out of the samples
+// around it. last_sample is first_sample.
+typedef void (*ripcheck_click_t)(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       window_offset,
+    uint16_t     channel,
+    size_t       last_window_sample,
+    size_t       first_sample,
+    size_t       last_sample);
+
+// Reports a range of samples that differ from the file the data is compared
+// with. channel_mask has the channels set that differ.
+typedef void (*ripcheck_difference_t)(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample);
+
 typedef void (*ripcheck_complete_t)(
     void        *data,
     const struct ripcheck_context *context);
 
+// Reports a range of samples that was analyzed if not all of them were.
+typedef void (*ripcheck_covered_t)(
+    void        *data,
+    const struct ripcheck_context *context,
+    size_t       first_sample,
+    size_t       last_sample);
+
 typedef void (*ripcheck_error_t)(
     void        *data,
     const struct ripcheck_context *context,
@@ -192,24 +347,45 @@ struct ripcheck_callbacks {
     ripcheck_complete_t      complete;
     ripcheck_error_t         error;
     ripcheck_warning_t       warning;
+    ripcheck_covered_t       covered;
+    ripcheck_clipping_t      clipping;
+    ripcheck_dropout_t       dropout;
+    ripcheck_click_t         click;
+    ripcheck_difference_t    difference;
 };
 
 int ripcheck(
     FILE *f,
     const char *filename,
-    ripcheck_time_t max_time,
-    ripcheck_time_t intro_length,
-    ripcheck_time_t outro_length,
-    ripcheck_time_t pop_drop_dist,
-    ripcheck_time_t dupe_dist,
-    ripcheck_volume_t pop_limit,
-    ripcheck_volume_t drop_limit,
-    ripcheck_volume_t dupe_limit,
-    size_t window_size,
-    size_t min_dupes,
-    size_t max_bad_areas,
+    const struct ripcheck_options *options,
     struct ripcheck_callbacks *callbacks);
 
+// Read the RIFF and fmt chunks, set up context and call callbacks->begin.
+// On success context has to be cleaned up with ripcheck_context_cleanup().
+int ripcheck_open(
+    FILE *f,
+    const char *filename,
+    const struct ripcheck_options *options,
+    struct ripcheck_context   *context,
+    struct ripcheck_callbacks *callbacks);
+
+// Skip to the data chunk and return its size. Returns ENOENT without
+// reporting an error if there is none.
+int ripcheck_find_data(
+    FILE *f,
+    const struct ripcheck_context *context,
+    struct ripcheck_callbacks *callbacks,
+    uint32_t *size);
+
+void ripcheck_context_cleanup(struct ripcheck_context *context);
+
+// Decode count frames of raw sample data into interleaved ints.
+void ripcheck_decode(
+    const struct ripcheck_context *context,
+    const uint8_t *data,
+    size_t count,
+    int *samples);
+
 #endif
 
 // vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,314 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ripcheck.h"
+#include "spectrum.h"
+
+// the noise floor is the mean power of the top 1/32 of the band
+#define SPECTRUM_FLOOR_BINS ((RIPCHECK_SPECTRUM_BINS - 1) / 32)
+// content has to be this much above the noise floor (20 dB)
+#define SPECTRUM_MARGIN 100.0
+
+// free the state of the running batch, but keep the power
+static void spectrum_free_state(struct ripcheck_spectrum *spectrum)
+{
+    ripcheck_fft_cleanup(&spectrum->fft);
+    free(spectrum->hann);
+    free(spectrum->input);
+    free(spectrum->decoded);
+    free(spectrum->re);
+    free(spectrum->im);
+
+    spectrum->hann    = NULL;
+    spectrum->input   = NULL;
+    spectrum->decoded = NULL;
+    spectrum->re      = NULL;
+    spectrum->im      = NULL;
+}
+
+void ripcheck_spectrum_cleanup(struct ripcheck_spectrum *spectrum)
+{
+    spectrum_free_state(spectrum);
+    free(spectrum->power);
+    spectrum->power = NULL;
+}
+
+int ripcheck_spectrum_init(struct ripcheck_spectrum *spectrum, const struct ripcheck_context *context)
+{
+    const size_t size     = RIPCHECK_SPECTRUM_SIZE;
+    const size_t channels = context->fmt.channels;
+
+    memset(spectrum, 0, sizeof(*spectrum));
+
+    spectrum->sample_rate = context->fmt.sample_rate;
+    spectrum->channels    = context->fmt.channels;
+
+    int errnum = ripcheck_fft_init(&spectrum->fft, size);
+    if (errnum != 0)
+    {
+        return errnum;
+    }
+
+    spectrum->power   = calloc(channels * RIPCHECK_SPECTRUM_BINS, sizeof(double));
+    spectrum->hann    = malloc(size * sizeof(double));
+    spectrum->input   = malloc(size * channels * sizeof(double));
+    spectrum->decoded = malloc(size * channels * sizeof(int));
+    spectrum->re      = malloc(size * sizeof(double));
+    spectrum->im      = malloc(size * sizeof(double));
+
+    if (!spectrum->power || !spectrum->hann || !spectrum->input ||
+        !spectrum->decoded || !spectrum->re || !spectrum->im)
+    {
+        errnum = errno;
+        ripcheck_spectrum_cleanup(spectrum);
+        return errnum;
+    }
+
+    // periodic Hann window, cos(2 pi k / size) is symmetric around size / 2
+    const size_t half = size / 2;
+    for (size_t k = 0; k < size; ++ k)
+    {
+        const double c = k < half ? spectrum->fft.cos[k] : k > half ? spectrum->fft.cos[size - k] : -1.0;
+        spectrum->hann[k] = 0.5 - 0.5 * c;
+    }
+
+    return 0;
+}
+
+// Transform the current window. Channels are transformed in pairs as the real
+// and the imaginary part of one complex FFT, their spectra are separated by
+// the symmetry of the transform of real data.
+static void spectrum_transform(struct ripcheck_spectrum *spectrum)
+{
+    const size_t size     = RIPCHECK_SPECTRUM_SIZE;
+    const size_t channels = spectrum->channels;
+    const double *hann    = spectrum->hann;
+    double *re = spectrum->re;
+    double *im = spectrum->im;
+
+    for (size_t channel = 0; channel < channels; channel += 2)
+    {
+        const double *a = spectrum->input + channel * size;
+        double *power_a = spectrum->power + channel * RIPCHECK_SPECTRUM_BINS;
+
+        if (channel + 1 < channels)
+        {
+            const double *b = a + size;
+            double *power_b = power_a + RIPCHECK_SPECTRUM_BINS;
+
+            for (size_t k = 0; k < size; ++ k)
+            {
+                re[k] = hann[k] * a[k];
+                im[k] = hann[k] * b[k];
+            }
+
+            ripcheck_fft_forward(&spectrum->fft, re, im);
+
+            for (size_t k = 0; k < RIPCHECK_SPECTRUM_BINS; ++ k)
+            {
+                const size_t n  = (size - k) & (size - 1);
+                const double sr = re[k] + re[n];
+                const double dr = re[k] - re[n];
+                const double si = im[k] + im[n];
+                const double di = im[k] - im[n];
+
+                power_a[k] += 0.25 * (sr * sr + di * di);
+                power_b[k] += 0.25 * (si * si + dr * dr);
+            }
+        }
+        else
+        {
+            for (size_t k = 0; k < size; ++ k)
+            {
+                re[k] = hann[k] * a[k];
+                im[k] = 0.0;
+            }
+
+            ripcheck_fft_forward(&spectrum->fft, re, im);
+
+            for (size_t k = 0; k < RIPCHECK_SPECTRUM_BINS; ++ k)
+            {
+                power_a[k] += re[k] * re[k] + im[k] * im[k];
+            }
+        }
+    }
+
+    ++ spectrum->windows;
+}
+
+void ripcheck_spectrum_update(
+    struct ripcheck_spectrum *spectrum,
+    const struct ripcheck_context *context,
+    const uint8_t *data,
+    size_t size)
+{
+    const size_t window_size = RIPCHECK_SPECTRUM_SIZE;
+    const size_t channels    = spectrum->channels;
+    const size_t block_align = context->fmt.block_align;
+    const size_t frames      = size / block_align;
+
+    for (size_t frame = 0; frame < frames;)
+    {
+        const uint64_t position = spectrum->frames + frame;
+
+        // skip everything between two batches without decoding it
+        if (position < spectrum->next_batch)
+        {
+            const uint64_t skip = spectrum->next_batch - position;
+            if (skip >= frames - frame)
+            {
+                break;
+            }
+            frame += skip;
+        }
+
+        size_t count = window_size - spectrum->filled;
+        if (count > frames - frame) count = frames - frame;
+
+        ripcheck_decode(context, data + frame * block_align, count, spectrum->decoded);
+
+        for (size_t channel = 0; channel < channels; ++ channel)
+        {
+            double *input = spectrum->input + channel * window_size + spectrum->filled;
+            const int *decoded = spectrum->decoded + channel;
+
+            for (size_t index = 0; index < count; ++ index)
+            {
+                input[index] = decoded[index * channels];
+            }
+        }
+
+        spectrum->filled += count;
+        frame += count;
+
+        if (spectrum->filled == window_size)
+        {
+            spectrum_transform(spectrum);
+
+            if (++ spectrum->batch_windows == RIPCHECK_SPECTRUM_BATCH)
+            {
+                spectrum->batch_windows = 0;
+                spectrum->filled        = 0;
+                spectrum->next_batch   += RIPCHECK_SPECTRUM_STRIDE;
+            }
+            else
+            {
+                // the next window starts in the middle of this one
+                const size_t half = window_size / 2;
+                for (size_t channel = 0; channel < channels; ++ channel)
+                {
+                    double *input = spectrum->input + channel * window_size;
+                    memcpy(input, input + half, half * sizeof(double));
+                }
+                spectrum->filled = half;
+            }
+        }
+    }
+
+    spectrum->frames += frames;
+}
+
+void ripcheck_spectrum_final(struct ripcheck_spectrum *spectrum)
+{
+    if (spectrum->windows == 0 && spectrum->filled > 0)
+    {
+        const size_t window_size = RIPCHECK_SPECTRUM_SIZE;
+
+        for (size_t channel = 0; channel < spectrum->channels; ++ channel)
+        {
+            double *input = spectrum->input + channel * window_size;
+            memset(input + spectrum->filled, 0, (window_size - spectrum->filled) * sizeof(double));
+        }
+
+        spectrum_transform(spectrum);
+    }
+
+    spectrum_free_state(spectrum);
+
+    if (spectrum->windows > 1)
+    {
+        const size_t count = (size_t)spectrum->channels * RIPCHECK_SPECTRUM_BINS;
+        for (size_t index = 0; index < count; ++ index)
+        {
+            spectrum->power[index] /= spectrum->windows;
+        }
+    }
+}
+
+uint32_t ripcheck_spectrum_bandwidth(const struct ripcheck_spectrum *spectrum, size_t channel)
+{
+    const double *power = spectrum->power + channel * RIPCHECK_SPECTRUM_BINS;
+    const size_t nyquist = RIPCHECK_SPECTRUM_BINS - 1;
+    double peak  = 0.0;
+    double noise = 0.0;
+
+    // the DC offset is not part of the band
+    for (size_t k = 1; k <= nyquist; ++ k)
+    {
+        if (power[k] > peak) peak = power[k];
+    }
+
+    if (peak == 0.0)
+    {
+        return 0;
+    }
+
+    for (size_t k = nyquist - SPECTRUM_FLOOR_BINS; k < nyquist; ++ k)
+    {
+        noise += power[k];
+    }
+
+    const double limit = noise / SPECTRUM_FLOOR_BINS * SPECTRUM_MARGIN;
+    size_t last = nyquist;
+
+    if (peak > limit)
+    {
+        while (power[last] <= limit)
+        {
+            -- last;
+        }
+    }
+
+    return (uint32_t)(((uint64_t)last * spectrum->sample_rate + RIPCHECK_SPECTRUM_SIZE / 2) /
+        RIPCHECK_SPECTRUM_SIZE);
+}
+
+int ripcheck_spectrum_copy(struct ripcheck_spectrum *dest, const struct ripcheck_spectrum *src)
+{
+    const size_t count = (size_t)src->channels * RIPCHECK_SPECTRUM_BINS;
+
+    memset(dest, 0, sizeof(*dest));
+    dest->sample_rate = src->sample_rate;
+    dest->channels    = src->channels;
+    dest->windows     = src->windows;
+    dest->power       = malloc(count * sizeof(double));
+
+    if (!dest->power)
+    {
+        return errno;
+    }
+
+    memcpy(dest->power, src->power, count * sizeof(double));
+    return 0;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,84 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_SPECTRUM_H__
+#define RIPCHECK_SPECTRUM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "fft.h"
+
+// frames per FFT window, windows of a batch overlap by half
+#define RIPCHECK_SPECTRUM_SIZE 4096
+// windows per batch and frames from the start of one batch to the next, so
+// only about every 14th frame is transformed
+#define RIPCHECK_SPECTRUM_BATCH  8
+#define RIPCHECK_SPECTRUM_STRIDE 262144
+#define RIPCHECK_SPECTRUM_BINS (RIPCHECK_SPECTRUM_SIZE / 2 + 1)
+
+struct ripcheck_context;
+
+// Average power spectrum of each channel of a data chunk that is gathered
+// while it is read. Only the first members are kept by ripcheck_spectrum_final().
+struct ripcheck_spectrum {
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint64_t windows;
+    // RIPCHECK_SPECTRUM_BINS bins from 0 Hz to sample_rate / 2 per channel
+    double  *power;
+
+    // state of the running batch
+    struct ripcheck_fft fft;
+    double  *hann;
+    // the samples of the current window, one channel after another
+    double  *input;
+    int     *decoded;
+    double  *re;
+    double  *im;
+    size_t   filled;
+    size_t   batch_windows;
+    uint64_t frames;
+    uint64_t next_batch;
+};
+
+int ripcheck_spectrum_init(struct ripcheck_spectrum *spectrum, const struct ripcheck_context *context);
+
+// Feed raw bytes of the data chunk. A truncated frame at the end is ignored.
+void ripcheck_spectrum_update(
+    struct ripcheck_spectrum *spectrum,
+    const struct ripcheck_context *context,
+    const uint8_t *data,
+    size_t size);
+
+// Average the power and free the state. Data shorter than one window is
+// padded with silence.
+void ripcheck_spectrum_final(struct ripcheck_spectrum *spectrum);
+
+// Frequency in Hz above which the spectrum of channel stays within 20 dB of
+// the noise floor at the top of the band. That is sample_rate / 2 if there
+// is no such drop and 0 if the channel is silent.
+uint32_t ripcheck_spectrum_bandwidth(const struct ripcheck_spectrum *spectrum, size_t channel);
+
+int ripcheck_spectrum_copy(struct ripcheck_spectrum *dest, const struct ripcheck_spectrum *src);
+
+void ripcheck_spectrum_cleanup(struct ripcheck_spectrum *spectrum);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
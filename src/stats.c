@@ -0,0 +1,164 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ripcheck.h"
+#include "stats.h"
+
+// Squares of up to 24 bit samples are summed as integers over this many
+// frames before they are added to the double. 32 bit samples only fit twice.
+#define STATS_CHUNK 65536
+
+void ripcheck_stats_cleanup(struct ripcheck_stats *stats)
+{
+    free(stats->channel);
+    stats->channel = NULL;
+}
+
+int ripcheck_stats_init(struct ripcheck_stats *stats, const struct wave_fmt *fmt)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    stats->channels        = fmt->channels;
+    stats->bits_per_sample = fmt->bits_per_sample;
+    stats->channel         = calloc(fmt->channels, sizeof(struct ripcheck_channel_stats));
+
+    if (!stats->channel) {
+        return errno;
+    }
+
+    for (size_t channel = 0; channel < stats->channels; ++ channel) {
+        stats->channel[channel].min = INT32_MAX;
+        stats->channel[channel].max = INT32_MIN;
+    }
+
+    return 0;
+}
+
+// Accumulate frames samples of one channel that are stride ints apart.
+static void stats_channel(
+    struct ripcheck_channel_stats *stats,
+    const int *samples,
+    size_t frames,
+    size_t stride,
+    unsigned int bits)
+{
+    // the squares of a chunk fit into 64 bits
+    const size_t chunk = bits <= 24 ? STATS_CHUNK : 2;
+
+    int32_t  min  = stats->min;
+    int32_t  max  = stats->max;
+    int64_t  sum  = stats->sum;
+    uint64_t zeros   = stats->zeros;
+    uint64_t repeats = stats->repeats;
+    uint64_t longest = stats->longest_repeat;
+    uint32_t used = stats->used_bits;
+    int32_t  last = stats->last;
+    uint64_t run  = stats->run;
+
+    for (size_t first = 0; first < frames; first += chunk) {
+        const size_t end = frames - first > chunk ? first + chunk : frames;
+        uint64_t squares = 0;
+
+        for (size_t frame = first; frame < end; ++ frame) {
+            const int x = samples[frame * stride];
+
+            if (x < min) min = x;
+            if (x > max) max = x;
+            sum     += x;
+            squares += (uint64_t)((int64_t)x * x);
+            zeros   += x == 0;
+            used    |= (uint32_t)x;
+
+            if (x == last) {
+                ++ run;
+                if (x != 0) {
+                    if (run == RIPCHECK_STATS_MIN_REPEATS) ++ repeats;
+                    if (run > longest) longest = run;
+                }
+            }
+            else {
+                last = x;
+                run  = 1;
+            }
+        }
+
+        stats->squares += (double)squares;
+    }
+
+    stats->min  = min;
+    stats->max  = max;
+    stats->sum  = sum;
+    stats->zeros   = zeros;
+    stats->repeats = repeats;
+    stats->longest_repeat = longest;
+    stats->used_bits = used;
+    stats->last = last;
+    stats->run  = run;
+}
+
+void ripcheck_stats_update(struct ripcheck_stats *stats, const int *samples, size_t frames)
+{
+    // one channel at a time, so the running values stay in registers
+    for (size_t channel = 0; channel < stats->channels; ++ channel) {
+        stats_channel(&stats->channel[channel], samples + channel, frames, stats->channels,
+            stats->bits_per_sample);
+    }
+
+    stats->frames += frames;
+}
+
+unsigned int ripcheck_stats_effective_bits(const struct ripcheck_stats *stats, size_t channel)
+{
+    const unsigned int bits = stats->bits_per_sample;
+    uint32_t used = stats->channel[channel].used_bits;
+
+    if (bits < 32) {
+        used &= ~(~0u << bits);
+    }
+
+    if (used == 0) {
+        return 0;
+    }
+
+    unsigned int padding = 0;
+    while (!(used & 1)) {
+        used >>= 1;
+        ++ padding;
+    }
+
+    return bits - padding;
+}
+
+int ripcheck_stats_copy(struct ripcheck_stats *dest, const struct ripcheck_stats *src)
+{
+    *dest = *src;
+    dest->channel = malloc(src->channels * sizeof(struct ripcheck_channel_stats));
+
+    if (!dest->channel) {
+        return errno;
+    }
+
+    memcpy(dest->channel, src->channel, src->channels * sizeof(struct ripcheck_channel_stats));
+    return 0;
+}
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4
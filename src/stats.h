@@ -0,0 +1,69 @@
+/**
+ *  ripcheck - find potential ripping errors in WAV files
+ *  Copyright (C) 2013  John Buckman of Magnatune, Mathias Panzenböck
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RIPCHECK_STATS_H__
+#define RIPCHECK_STATS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// runs of at least this many equal non-zero samples are counted as repeats
+#define RIPCHECK_STATS_MIN_REPEATS 4
+
+struct wave_fmt;
+
+// Summary of all samples of one channel in the bits per sample of the file.
+struct ripcheck_channel_stats {
+    int32_t  min;
+    int32_t  max;
+    int64_t  sum;
+    double   squares;
+    uint64_t zeros;
+    // runs of equal non-zero samples
+    uint64_t repeats;
+    uint64_t longest_repeat;
+    // OR of all samples, bits that are never set are padding
+    uint32_t used_bits;
+    // the run that is still going on at the end of the data so far
+    int32_t  last;
+    uint64_t run;
+};
+
+// Per channel statistics of a data chunk that are gathered while it is read.
+struct ripcheck_stats {
+    uint16_t channels;
+    uint16_t bits_per_sample;
+    uint64_t frames;
+    struct ripcheck_channel_stats *channel;
+};
+
+int ripcheck_stats_init(struct ripcheck_stats *stats, const struct wave_fmt *fmt);
+
+// Feed frames frames of samples as decoded by ripcheck_decode().
+void ripcheck_stats_update(struct ripcheck_stats *stats, const int *samples, size_t frames);
+
+// bits per sample minus the padding bits that are zero in every sample
+unsigned int ripcheck_stats_effective_bits(const struct ripcheck_stats *stats, size_t channel);
+
+int ripcheck_stats_copy(struct ripcheck_stats *dest, const struct ripcheck_stats *src);
+
+void ripcheck_stats_cleanup(struct ripcheck_stats *stats);
+
+#endif
+
+// vim: tabstop=4 expandtab shiftwidth=4 softtabstop=4